@@ -382,6 +382,9 @@ static gboolean amidiplug_play (InputPlayback * playback, const gchar *
       i_midi_setget_length( &midifile );
       DEBUGMSG( "PLAY requested, song length calculated: %i msec\n" , (gint)(midifile.length / 1000) );
 
+      /* take channel state snapshots, used for seeking */
+      i_midi_file_build_snapshots( &midifile );
+
       playback->set_params (playback, au_bitdepth * au_samplerate * au_channels
        / 8, au_samplerate, au_channels);
 
@@ -525,17 +528,22 @@ static void do_pause (gboolean pause)
 
 static void amidiplug_play_loop (InputPlayback * playback)
 {
-  gint j = 0;
   gboolean rewind = TRUE, paused = FALSE, stopped = FALSE;
+  /* non-realtime mode: the backend renders audio in this thread, up to the
+     next event, and the output plugin alone paces the playback */
+  gboolean offline = ( ! backend.autonomous_audio && backend.seq_output_until );
+  void * buffer = NULL;
+  gint buffer_size = 0;
+  gint64 rendered = 0;
+  GTimer * timer = g_timer_new ();
 
   if ( rewind )
   {
-    /* initialize current position in each track */
-    for (j = 0; j < midifile.num_tracks; ++j)
-      midifile.tracks[j].current_event = midifile.tracks[j].first_event;
+    /* initialize current position in the timeline */
+    midifile.current_event = 0;
   }
 
-  if (! backend.autonomous_audio)
+  if (! backend.autonomous_audio && ! offline)
       audio_start (playback);
 
   /* queue start */
@@ -547,8 +555,6 @@ static void amidiplug_play_loop (InputPlayback * playback)
   for (;;)
   {
     midievent_t * event = NULL;
-    midifile_track_t * event_track = NULL;
-    gint i, min_tick = midifile.max_tick + 1;
 
     g_mutex_lock (amidiplug_playing_mutex);
 
@@ -561,7 +567,9 @@ static void amidiplug_play_loop (InputPlayback * playback)
 
     if (amidiplug_playing_status == AMIDIPLUG_SEEK)
     {
-        if (! backend.autonomous_audio)
+        if (offline)
+            playback->output->flush (seek_time);
+        else if (! backend.autonomous_audio)
             audio_seek (seek_time);
 
         /* WORKAROUND: wait till unpause to seek */
@@ -579,9 +587,12 @@ static void amidiplug_play_loop (InputPlayback * playback)
     {
         if (! paused)
         {
-            do_pause (TRUE);
+            if (offline)
+                playback->output->pause (TRUE);
+            else
+                do_pause (TRUE);
 
-            if (! backend.autonomous_audio)
+            if (! backend.autonomous_audio && ! offline)
                 audio_pause (TRUE);
 
             paused = TRUE;
@@ -595,9 +606,12 @@ static void amidiplug_play_loop (InputPlayback * playback)
 
     if (paused)
     {
-        do_pause (FALSE);
+        if (offline)
+            playback->output->pause (FALSE);
+        else
+            do_pause (FALSE);
 
-        if (! backend.autonomous_audio)
+        if (! backend.autonomous_audio && ! offline)
             audio_pause (FALSE);
 
         /* WORKAROUND (see above) */
@@ -613,27 +627,34 @@ static void amidiplug_play_loop (InputPlayback * playback)
 
     g_mutex_unlock (amidiplug_playing_mutex);
 
-    /* search next event */
-    for (i = 0; i < midifile.num_tracks; ++i)
+    if ( midifile.current_event >= midifile.num_events )
     {
-      midifile_track_t * track = &midifile.tracks[i];
-      midievent_t * e2 = track->current_event;
-      if (( e2 ) && ( e2->tick < min_tick ))
+      /* render the tail of the song, up to max_tick */
+      if ( offline && backend.seq_output_until( midifile.max_tick - midifile.skip_offset ,
+                                                &buffer , &buffer_size ) )
       {
-        min_tick = e2->tick;
-        event = e2;
-        event_track = track;
+        playback->output->write_audio( buffer , buffer_size );
+        rendered += buffer_size;
+        continue;
       }
-    }
-
-    if (!event)
       break; /* end of song reached */
+    }
 
-    /* advance pointer to next event */
-    event_track->current_event = event->next;
+    event = midifile.events[midifile.current_event];
     /* consider the midifile.skip_offset */
     event->tick_real = event->tick - midifile.skip_offset;
 
+    /* render audio up to the next event, one block at a time */
+    if ( offline && backend.seq_output_until( event->tick_real , &buffer , &buffer_size ) )
+    {
+      playback->output->write_audio( buffer , buffer_size );
+      rendered += buffer_size;
+      continue;
+    }
+
+    /* advance to next event */
+    midifile.current_event++;
+
 
     switch (event->type)
     {
@@ -694,113 +715,117 @@ static void amidiplug_play_loop (InputPlayback * playback)
   backend.seq_output_shut (stopped ? midifile.playing_tick : midifile.max_tick,
    midifile.skip_offset);
 
-  if (! backend.autonomous_audio)
+  if (! backend.autonomous_audio && ! offline)
       audio_stop ();
 
+  if ( offline )
+  {
+    gint au_samplerate = -1, au_bitdepth = -1, au_channels = -1;
+    backend.audio_info_get( &au_channels , &au_bitdepth , &au_samplerate );
+    DEBUGMSG( "PLAY thread, rendered %.1f s of audio in %.1f s (%.1fx realtime)\n" ,
+              (gdouble)rendered / ( au_samplerate * au_channels * au_bitdepth / 8 ) ,
+              g_timer_elapsed( timer , NULL ) ,
+              (gdouble)rendered / ( au_samplerate * au_channels * au_bitdepth / 8 ) /
+              g_timer_elapsed( timer , NULL ) );
+  }
+
+  g_timer_destroy (timer);
+  g_free (buffer);
+
   backend.seq_off ();
   backend.seq_stop ();
   i_midi_free (& midifile);
 }
 
 
+/* re-do an event that influences the playing of our midi file, using a
+   time-tick of 0 so that it is processed istantaneously */
+static void amidiplug_skipto_event( midievent_t * event )
+{
+  /* set the time tick to 0 */
+  event->tick_real = 0;
+
+  switch (event->type)
+  {
+    /* do nothing for these
+    case SND_SEQ_EVENT_NOTEON:
+    case SND_SEQ_EVENT_NOTEOFF:
+    case SND_SEQ_EVENT_KEYPRESS:
+    {
+      break;
+    } */
+    case SND_SEQ_EVENT_CONTROLLER:
+      backend.seq_event_controller( event );
+      break;
+    case SND_SEQ_EVENT_PGMCHANGE:
+      backend.seq_event_pgmchange( event );
+      break;
+    case SND_SEQ_EVENT_CHANPRESS:
+      backend.seq_event_chanpress( event );
+      break;
+    case SND_SEQ_EVENT_PITCHBEND:
+      backend.seq_event_pitchbend( event );
+      break;
+    case SND_SEQ_EVENT_SYSEX:
+      backend.seq_event_sysex( event );
+      break;
+    case SND_SEQ_EVENT_TEMPO:
+      backend.seq_event_tempo( event );
+      g_mutex_lock( amidiplug_gettime_mutex );
+      midifile.current_tempo = event->data.tempo;
+      g_mutex_unlock( amidiplug_gettime_mutex );
+      break;
+  }
+
+  if ( backend.autonomous_audio == TRUE )
+  {
+    /* these backends deal with audio production themselves (i.e. ALSA) */
+    backend.seq_output( NULL , NULL );
+  }
+}
+
+
 /* amidigplug_skipto: re-do all events that influence the playing of our
-   midi file; re-do them using a time-tick of 0, so they are processed
-   istantaneously and proceed this way until the playing_tick is reached;
+   midi file; the channel state is restored from the nearest snapshot before
+   the playing_tick, then the events between the snapshot and the playing_tick
+   are re-done using a time-tick of 0, so they are processed istantaneously;
    also obtain the correct skip_offset from the playing_tick */
 void amidiplug_skipto( gint playing_tick )
 {
-  gint i;
+  midifile_snapshot_t * snapshot;
+  gint i, s, target;
 
   /* this check is always made, for safety*/
   if ( playing_tick >= midifile.max_tick )
     playing_tick = midifile.max_tick - 1;
 
-  /* initialize current position in each track */
-  for (i = 0; i < midifile.num_tracks; ++i)
-    midifile.tracks[i].current_event = midifile.tracks[i].first_event;
-
   /* common settings for all our events */
   backend.seq_event_init();
   backend.seq_queue_start();
 
-  DEBUGMSG( "SKIPTO request, starting skipto loop\n" );
-  for (;;)
-  {
-    midievent_t * event = NULL;
-    midifile_track_t * event_track = NULL;
-    gint i, min_tick = midifile.max_tick + 1;
+  /* find the first event to be played and the snapshot before it */
+  target = i_midi_file_find_event( &midifile , playing_tick );
+  snapshot = &midifile.snapshots[target / MIDI_SNAPSHOT_INTERVAL];
 
-    /* search next event */
-    for (i = 0; i < midifile.num_tracks; ++i)
-    {
-      midifile_track_t * track = &midifile.tracks[i];
-      midievent_t * e2 = track->current_event;
-      if (( e2 ) && ( e2->tick < min_tick ))
-      {
-        min_tick = e2->tick;
-        event = e2;
-        event_track = track;
-      }
-    }
+  DEBUGMSG( "SKIPTO request, event %i, restoring snapshot at event %i\n" ,
+            target , snapshot->event );
 
-    /* unlikely here... unless very strange MIDI files are played :) */
-    if (!event)
-    {
-      DEBUGMSG( "SKIPTO request, reached the last event but not the requested tick (!)\n" );
-      break; /* end of song reached */
-    }
-
-    /* reached the requested tick, job done */
-    if ( event->tick >= playing_tick )
-    {
-      DEBUGMSG( "SKIPTO request, reached the requested tick, exiting from skipto loop\n" );
-      break;
-    }
-
-    /* advance pointer to next event */
-    event_track->current_event = event->next;
-    /* set the time tick to 0 */
-    event->tick_real = 0;
-
-    switch (event->type)
-    {
-      /* do nothing for these
-      case SND_SEQ_EVENT_NOTEON:
-      case SND_SEQ_EVENT_NOTEOFF:
-      case SND_SEQ_EVENT_KEYPRESS:
-      {
-        break;
-      } */
-      case SND_SEQ_EVENT_CONTROLLER:
-        backend.seq_event_controller( event );
-        break;
-      case SND_SEQ_EVENT_PGMCHANGE:
-        backend.seq_event_pgmchange( event );
-        break;
-      case SND_SEQ_EVENT_CHANPRESS:
-        backend.seq_event_chanpress( event );
-        break;
-      case SND_SEQ_EVENT_PITCHBEND:
-        backend.seq_event_pitchbend( event );
-        break;
-      case SND_SEQ_EVENT_SYSEX:
-        backend.seq_event_sysex( event );
-        break;
-      case SND_SEQ_EVENT_TEMPO:
-        backend.seq_event_tempo( event );
-        g_mutex_lock( amidiplug_gettime_mutex );
-        midifile.current_tempo = event->data.tempo;
-        g_mutex_unlock( amidiplug_gettime_mutex );
-        break;
-    }
-
-    if ( backend.autonomous_audio == TRUE )
-    {
-      /* these backends deal with audio production themselves (i.e. ALSA) */
-      backend.seq_output( NULL , NULL );
-    }
+  /* restore the snapshot state, sysex and RPN/NRPN events included, in
+     original order */
+  for ( i = 0 , s = 0 ; i < snapshot->num_state || s < snapshot->num_replay ; )
+  {
+    if ( s == snapshot->num_replay ||
+         ( i < snapshot->num_state && snapshot->state[i] < midifile.replay[s] ) )
+      amidiplug_skipto_event( midifile.events[snapshot->state[i++]] );
+    else
+      amidiplug_skipto_event( midifile.events[midifile.replay[s++]] );
   }
 
+  /* re-do the events between the snapshot and the requested tick */
+  for ( i = snapshot->event ; i < target ; ++i )
+    amidiplug_skipto_event( midifile.events[i] );
+
+  midifile.current_event = target;
   midifile.skip_offset = playing_tick;
 
   return;
@@ -134,6 +134,7 @@ gint sequencer_stop( void )
 gint sequencer_on( void )
 {
   sc.tick_offset = 0;
+  sc.offline = FALSE;
 
   return 1; /* success */
 }
@@ -158,6 +159,10 @@ gint sequencer_queue_tempo( gint tempo , gint ppq )
 
 gint sequencer_queue_start (void)
 {
+    /* the timer restarts from the (new) skip offset */
+    sc.tick_offset = 0;
+    sc.offline_frames = 0;
+
     g_mutex_lock (timer_mutex);
     timer = 0;
     g_mutex_unlock (timer_mutex);
@@ -264,6 +269,7 @@ gint sequencer_event_tempo( midievent_t * event )
   /* sc.cur_tick_per_sec = (gdouble)( sc.ppq * 1000000 ) / (gdouble)event->data.tempo; */
   sc.cur_microsec_per_tick = (gdouble)event->data.tempo / (gdouble)sc.ppq;
   sc.tick_offset = event->tick_real;
+  sc.offline_frames = 0;
 
   g_mutex_lock (timer_mutex);
   timer = 0;
@@ -309,6 +315,34 @@ gint sequencer_output (void * * buffer, gint * length)
 }
 
 
+/* non-realtime output: renders the next block of audio (at most 10 ms) up to
+   the time of tick, in the calling thread and with no timer pacing; returns 0
+   once the synth has caught up with tick, so the event can be sent */
+gint sequencer_output_until (guint tick, void * * buffer, gint * length)
+{
+    gdouble usecs = (gdouble) ((gint) tick - (gint) sc.tick_offset) * sc.cur_microsec_per_tick;
+    gint64 target = (gint64) ceil (usecs * sc.sample_rate / 1000000);
+    gint frames = MIN (target - sc.offline_frames, sc.sample_rate / 100);
+
+    sc.offline = TRUE;
+
+    if (frames <= 0)
+        return 0;
+
+    * buffer = g_realloc (* buffer, 4 * (sc.sample_rate / 100));
+    * length = 4 * frames;
+    fluid_synth_write_s16 (sc.synth, frames, * buffer, 0, 2, * buffer, 1, 2);
+
+    sc.offline_frames += frames;
+
+    g_mutex_lock (timer_mutex);
+    timer = sc.offline_frames * 1000000 / sc.sample_rate;
+    g_mutex_unlock (timer_mutex);
+
+    return 1;
+}
+
+
 gint sequencer_output_shut( guint max_tick , gint skip_offset )
 {
   i_sleep (max_tick - skip_offset);
@@ -354,6 +388,10 @@ void i_sleep( guint tick )
 {
   gdouble elapsed_tick_usecs = (gdouble)(tick - sc.tick_offset) * sc.cur_microsec_per_tick;
 
+  /* in non-realtime mode audio has already been rendered up to tick */
+  if ( sc.offline )
+    return;
+
   g_mutex_lock (timer_mutex);
 
   while (timer < elapsed_tick_usecs)
@@ -41,6 +41,9 @@ typedef struct
   guint tick_offset;
 
   guint sample_rate;
+
+  gboolean offline;		/* audio is rendered by sequencer_output_until */
+  gint64 offline_frames;	/* frames rendered since the timer was reset */
 }
 sequencer_client_t;
 
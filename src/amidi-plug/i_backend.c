@@ -151,6 +151,7 @@ gint i_backend_load( gchar * module_name )
     backend.seq_event_tempo = get_symbol (backend.gmodule, "sequencer_event_tempo");
     backend.seq_event_other = get_symbol (backend.gmodule, "sequencer_event_other");
     backend.seq_output = get_symbol (backend.gmodule, "sequencer_output");
+    backend.seq_output_until = get_symbol (backend.gmodule, "sequencer_output_until");
     backend.seq_output_shut = get_symbol (backend.gmodule, "sequencer_output_shut");
     backend.seq_get_port_count = get_symbol (backend.gmodule, "sequencer_get_port_count");
 
@@ -68,6 +68,7 @@ typedef struct
   gint (*seq_event_tempo)( midievent_t * );
   gint (*seq_event_other)( midievent_t * );
   gint (*seq_output)( gpointer * , gint * );
+  gint (*seq_output_until)( guint , gpointer * , gint * ); /* optional */
   gint (*seq_output_shut)( guint , gint );
   gint (*seq_get_port_count)( void );
   gboolean autonomous_audio;
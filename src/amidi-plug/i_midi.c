@@ -451,11 +451,208 @@ gint i_midi_file_parse_smf( midifile_t * mf , gint port_count )
       mf->max_tick = mf->tracks[i].end_tick;
   }
 
+  /* merge all tracks in a single timeline */
+  i_midi_file_build_timeline( mf );
+
   /* ok, success */
   return 1;
 }
 
 
+typedef struct
+{
+  midievent_t * event;
+  gint order;
+}
+timeline_entry_t;
+
+static gint i_midi_timeline_compare( gconstpointer a , gconstpointer b )
+{
+  const timeline_entry_t * ea = a, * eb = b;
+
+  if ( ea->event->tick != eb->event->tick )
+    return ( ea->event->tick < eb->event->tick ) ? -1 : 1;
+
+  /* same tick: first track first, then track order */
+  return ea->order - eb->order;
+}
+
+static gint i_midi_index_compare( gconstpointer a , gconstpointer b )
+{
+  return *(const gint *)a - *(const gint *)b;
+}
+
+
+/* merges the events of all tracks in a single array sorted by tick; events
+   with the same tick are kept in the order they would be picked scanning the
+   tracks one after another */
+void i_midi_file_build_timeline( midifile_t * mf )
+{
+  timeline_entry_t * entries;
+  gint i, n = 0;
+
+  mf->num_events = 0;
+  for ( i = 0 ; i < mf->num_tracks ; ++i )
+  {
+    midievent_t * event;
+    for ( event = mf->tracks[i].first_event ; event ; event = event->next )
+      mf->num_events++;
+  }
+
+  entries = g_new( timeline_entry_t , mf->num_events );
+  for ( i = 0 ; i < mf->num_tracks ; ++i )
+  {
+    midievent_t * event;
+    for ( event = mf->tracks[i].first_event ; event ; event = event->next )
+    {
+      entries[n].event = event;
+      entries[n].order = n;
+      n++;
+    }
+  }
+
+  qsort( entries , mf->num_events , sizeof(timeline_entry_t) , i_midi_timeline_compare );
+
+  mf->events = g_new( midievent_t * , mf->num_events );
+  for ( i = 0 ; i < mf->num_events ; ++i )
+    mf->events[i] = entries[i].event;
+
+  g_free( entries );
+  mf->current_event = 0;
+}
+
+
+/* RPN/NRPN parameter select and data entry controllers; a data entry applies
+   to whichever parameter was selected last, so these must all be replayed in
+   their original order instead of keeping only the last value of each */
+static gboolean i_midi_is_param_controller( gint controller )
+{
+  switch ( controller )
+  {
+    case 6: case 38:		/* data entry MSB, LSB */
+    case 96: case 97:		/* data increment, decrement */
+    case 98: case 99:		/* NRPN LSB, MSB */
+    case 100: case 101:		/* RPN LSB, MSB */
+      return TRUE;
+    default:
+      return FALSE;
+  }
+}
+
+
+/* returns the slot that holds the last value of the state changed by event,
+   or -1 if the event doesn't change channel state */
+static gint i_midi_state_key( midievent_t * event , gint num_ports )
+{
+  gint channel = event->port * 16 + ( event->data.d[0] & 0x0f );
+
+  switch ( event->type )
+  {
+    case SND_SEQ_EVENT_CONTROLLER:
+      return channel * 131 + event->data.d[1];
+    case SND_SEQ_EVENT_PGMCHANGE:
+      return channel * 131 + 128;
+    case SND_SEQ_EVENT_CHANPRESS:
+      return channel * 131 + 129;
+    case SND_SEQ_EVENT_PITCHBEND:
+      return channel * 131 + 130;
+    case SND_SEQ_EVENT_TEMPO:
+      return num_ports * 16 * 131;
+    default:
+      return -1;
+  }
+}
+
+
+/* takes a snapshot of the channel state every MIDI_SNAPSHOT_INTERVAL events;
+   a snapshot lists the last event that set each controller, program, channel
+   pressure, pitch bend and tempo, so that a seek only needs to replay those
+   (plus the sysex and RPN/NRPN events, which cannot be collapsed) and the
+   events between the snapshot and the seek position */
+void i_midi_file_build_snapshots( midifile_t * mf )
+{
+  GArray * replay = g_array_new( FALSE , FALSE , sizeof(gint) );
+  gint * last;
+  gint i, num_ports = 1, num_keys;
+
+  for ( i = 0 ; i < mf->num_events ; ++i )
+  {
+    if ( mf->events[i]->type != SND_SEQ_EVENT_META_TEXT &&
+         mf->events[i]->type != SND_SEQ_EVENT_META_LYRIC &&
+         mf->events[i]->port >= num_ports )
+      num_ports = mf->events[i]->port + 1;
+  }
+
+  num_keys = num_ports * 16 * 131 + 1;
+  last = g_new( gint , num_keys );
+  for ( i = 0 ; i < num_keys ; ++i )
+    last[i] = -1;
+
+  mf->num_snapshots = mf->num_events / MIDI_SNAPSHOT_INTERVAL + 1;
+  mf->snapshots = g_new0( midifile_snapshot_t , mf->num_snapshots );
+
+  for ( i = 0 ; i <= mf->num_events ; ++i )
+  {
+    gint key;
+
+    if ( i % MIDI_SNAPSHOT_INTERVAL == 0 )
+    {
+      midifile_snapshot_t * snapshot = &mf->snapshots[i / MIDI_SNAPSHOT_INTERVAL];
+      gint k;
+
+      snapshot->event = i;
+      snapshot->num_replay = replay->len;
+      snapshot->state = g_new( gint , num_keys );
+      for ( k = 0 ; k < num_keys ; ++k )
+      {
+        if ( last[k] >= 0 )
+          snapshot->state[snapshot->num_state++] = last[k];
+      }
+
+      /* keep the original order, e.g. bank select before program change */
+      qsort( snapshot->state , snapshot->num_state , sizeof(gint) , i_midi_index_compare );
+      snapshot->state = g_renew( gint , snapshot->state , snapshot->num_state );
+    }
+
+    if ( i == mf->num_events )
+      break;
+
+    if ( mf->events[i]->type == SND_SEQ_EVENT_SYSEX ||
+         ( mf->events[i]->type == SND_SEQ_EVENT_CONTROLLER &&
+           i_midi_is_param_controller( mf->events[i]->data.d[1] ) ) )
+      g_array_append_val( replay , i );
+    else if (( key = i_midi_state_key( mf->events[i] , num_ports ) ) >= 0 )
+      last[key] = i;
+  }
+
+  mf->num_replay = replay->len;
+  mf->replay = (gint *) g_array_free( replay , FALSE );
+  g_free( last );
+
+  DEBUGMSG( "TIMELINE: %i events, %i snapshots, %i replayed events\n" ,
+            mf->num_events , mf->num_snapshots , mf->num_replay );
+}
+
+
+/* returns the index of the first event at or after tick */
+gint i_midi_file_find_event( midifile_t * mf , gint tick )
+{
+  gint low = 0, high = mf->num_events;
+
+  while ( low < high )
+  {
+    gint mid = low + ( high - low ) / 2;
+
+    if ( (gint) mf->events[mid]->tick < tick )
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return low;
+}
+
+
 /* read a MIDI file enclosed in RIFF format */
 /* return values: 0 = error , 1 = ok */
 gint i_midi_file_parse_riff( midifile_t * mf )
@@ -502,6 +699,13 @@ void i_midi_init( midifile_t * mf )
   mf->file_offset = 0;
   mf->num_tracks = 0;
   mf->tracks = NULL;
+  mf->num_events = 0;
+  mf->events = NULL;
+  mf->current_event = 0;
+  mf->num_snapshots = 0;
+  mf->snapshots = NULL;
+  mf->num_replay = 0;
+  mf->replay = NULL;
   mf->max_tick = 0;
   mf->smpte_timing = 0;
   mf->format = 0;
@@ -521,6 +725,24 @@ void i_midi_free( midifile_t * mf )
   g_free(mf->file_name);
   mf->file_name = NULL;
 
+  if ( mf->snapshots )
+  {
+    gint i;
+    for ( i = 0 ; i < mf->num_snapshots ; ++i )
+      g_free( mf->snapshots[i].state );
+    g_free( mf->snapshots );
+    mf->snapshots = NULL;
+    mf->num_snapshots = 0;
+  }
+
+  g_free( mf->replay );
+  mf->replay = NULL;
+  mf->num_replay = 0;
+
+  g_free( mf->events );
+  mf->events = NULL;
+  mf->num_events = 0;
+
   if ( mf->tracks )
   {
     gint i;
@@ -599,8 +821,7 @@ gint i_midi_setget_tempo( midifile_t * mf )
 }
 
 
-/* this will set the midi length in microseconds
-   COMMENT: this will also reset current position in each track! */
+/* this will set the midi length in microseconds */
 void i_midi_setget_length( midifile_t * mf )
 {
   gint64 length_microsec = 0;
@@ -608,42 +829,11 @@ void i_midi_setget_length( midifile_t * mf )
   /* get the first microsec_per_tick ratio */
   gint microsec_per_tick = (gint)(mf->current_tempo / mf->ppq);
 
-  /* initialize current position in each track */
-  for (i = 0; i < mf->num_tracks; ++i)
-    mf->tracks[i].current_event = mf->tracks[i].first_event;
-
-  /* search for tempo events in each track; in fact, since the program
-     currently supports type 0 and type 1 MIDI files, we should find
-     tempo events only in one track */
+  /* search for tempo events in the timeline */
   DEBUGMSG( "LENGTH calc: starting calc loop\n" );
-  for (;;)
+  for ( i = 0 ; i < mf->num_events ; ++i )
   {
-    midievent_t * event = NULL;
-    midifile_track_t * event_track = NULL;
-    gint i, min_tick = mf->max_tick + 1;
-
-    /* search next event */
-    for ( i = 0 ; i < mf->num_tracks ; ++i )
-    {
-      midifile_track_t * track = &mf->tracks[i];
-      midievent_t * e2 = track->current_event;
-      if (e2 && e2->tick < min_tick)
-      {
-        min_tick = e2->tick;
-        event = e2;
-        event_track = track;
-      }
-    }
-
-    if (!event)
-    {
-      /* calculate the remaining length */
-      length_microsec += ( microsec_per_tick * ( mf->max_tick - last_tick ) );
-      break; /* end of song reached */
-    }
-
-    /* advance pointer to next event */
-    event_track->current_event = event->next;
+    midievent_t * event = mf->events[i];
 
     /* check if this is a tempo event */
     if ( event->type == SND_SEQ_EVENT_TEMPO )
@@ -658,6 +848,9 @@ void i_midi_setget_length( midifile_t * mf )
     }
   }
 
+  /* calculate the remaining length */
+  length_microsec += ( microsec_per_tick * ( mf->max_tick - last_tick ) );
+
   /* IMPORTANT
      this couple of important values is set by i_midi_set_length */
   mf->length = length_microsec;
@@ -670,8 +863,7 @@ void i_midi_setget_length( midifile_t * mf )
 
 
 /* this will get the weighted average bpm of the midi file;
-   if the file has a variable bpm, 'bpm' is set to -1;
-   COMMENT: this will also reset current position in each track! */
+   if the file has a variable bpm, 'bpm' is set to -1 */
 void i_midi_get_bpm( midifile_t * mf , gint * bpm , gint * wavg_bpm )
 {
   gint i = 0 , last_tick = 0;
@@ -679,42 +871,11 @@ void i_midi_get_bpm( midifile_t * mf , gint * bpm , gint * wavg_bpm )
   gboolean is_monotempo = TRUE;
   gint last_tempo = mf->current_tempo;
 
-  /* initialize current position in each track */
-  for ( i = 0 ; i < mf->num_tracks ; ++i )
-    mf->tracks[i].current_event = mf->tracks[i].first_event;
-
-  /* search for tempo events in each track; in fact, since the program
-     currently supports type 0 and type 1 MIDI files, we should find
-     tempo events only in one track */
+  /* search for tempo events in the timeline */
   DEBUGMSG( "BPM calc: starting calc loop\n" );
-  for (;;)
+  for ( i = 0 ; i < mf->num_events ; ++i )
   {
-    midievent_t * event = NULL;
-    midifile_track_t * event_track = NULL;
-    gint i, min_tick = mf->max_tick + 1;
-
-    /* search next event */
-    for ( i = 0 ; i < mf->num_tracks ; ++i )
-    {
-      midifile_track_t * track = &mf->tracks[i];
-      midievent_t * e2 = track->current_event;
-      if (e2 && e2->tick < min_tick)
-      {
-        min_tick = e2->tick;
-        event = e2;
-        event_track = track;
-      }
-    }
-
-    if (!event)
-    {
-      /* calculate the remaining length */
-      weighted_avg_tempo += (guint)( last_tempo * ((gfloat)( mf->max_tick - last_tick ) / (gfloat)mf->max_tick ) );
-      break; /* end of song reached */
-    }
-
-    /* advance pointer to next event */
-    event_track->current_event = event->next;
+    midievent_t * event = mf->events[i];
 
     /* check if this is a tempo event */
     if ( event->type == SND_SEQ_EVENT_TEMPO )
@@ -734,6 +895,9 @@ void i_midi_get_bpm( midifile_t * mf , gint * bpm , gint * wavg_bpm )
     }
   }
 
+  /* calculate the remaining length */
+  weighted_avg_tempo += (guint)( last_tempo * ((gfloat)( mf->max_tick - last_tick ) / (gfloat)mf->max_tick ) );
+
   DEBUGMSG( "BPM calc: weighted average tempo: %i\n" , weighted_avg_tempo );
 
   *wavg_bpm = (gint)( 60000000 / weighted_avg_tempo );
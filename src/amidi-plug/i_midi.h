@@ -27,6 +27,9 @@
 
 #define MAKE_ID(c1, c2, c3, c4) ((c1) | ((c2) << 8) | ((c3) << 16) | ((c4) << 24))
 
+/* number of events between two channel state snapshots */
+#define MIDI_SNAPSHOT_INTERVAL 1024
+
 
 /* sequencer event type, got from ALSA header alsa/seq_event.h */
 enum snd_seq_event_type {
@@ -229,10 +232,19 @@ typedef struct
 {
   midievent_t * first_event;	/* list of all events in this track */
   gint end_tick;			/* length of this track */
-  midievent_t * current_event;	/* used while loading and playing */
+  midievent_t * current_event;	/* used while loading */
 }
 midifile_track_t;
 
+typedef struct
+{
+  gint event;			/* index of the first event after the snapshot */
+  gint num_state;
+  gint * state;			/* indexes of the events that rebuild channel state */
+  gint num_replay;		/* number of replayed events before the snapshot */
+}
+midifile_snapshot_t;
+
 typedef struct
 {
   VFSFile * file_pointer;
@@ -242,6 +254,17 @@ typedef struct
   gint num_tracks;
   midifile_track_t *tracks;
 
+  /* events of all tracks merged in a single tick-sorted timeline */
+  gint num_events;
+  midievent_t ** events;
+  gint current_event;		/* used while playing */
+
+  /* channel state snapshots, one every MIDI_SNAPSHOT_INTERVAL events */
+  gint num_snapshots;
+  midifile_snapshot_t * snapshots;
+  gint num_replay;
+  gint * replay;		/* indexes of the events that are always replayed */
+
   gushort format;
   guint max_tick;
   gint smpte_timing;
@@ -270,6 +293,9 @@ gint i_midi_file_read_var( midifile_t * );
 gint i_midi_file_read_track( midifile_t * , midifile_track_t * , gint , gint );
 gint i_midi_file_parse_riff( midifile_t * );
 gint i_midi_file_parse_smf( midifile_t * , gint );
+void i_midi_file_build_timeline( midifile_t * );
+void i_midi_file_build_snapshots( midifile_t * );
+gint i_midi_file_find_event( midifile_t * , gint );
 void i_midi_init( midifile_t * );
 void i_midi_free( midifile_t * );
 gint i_midi_setget_tempo( midifile_t * );
@@ -46,6 +46,7 @@ typedef struct
 {
   cairo_surface_t * surface;
   gfloat alpha;
+  gboolean by_opacity; /* fade by window opacity, render only once */
   gpointer user_data;
   gint width;
   gint height;
@@ -160,7 +161,21 @@ aosd_fade_func ( Ghosd * gosd , cairo_t * cr , void * user_data )
   }
 
   cairo_set_source_surface( cr , fade_data->surface , 0 , 0 );
-  cairo_paint_with_alpha( cr , fade_data->alpha );
+  cairo_paint_with_alpha( cr , fade_data->by_opacity ? 1.0 : fade_data->alpha );
+}
+
+
+static void
+aosd_fade_update ( void )
+{
+  /* with a compositing manager running, let it do the blending; otherwise
+     repaint the cached surface with the new alpha */
+  if ( osd_data->fade_data.by_opacity )
+    ghosd_set_opacity( osd , osd_data->fade_data.alpha );
+  else
+    ghosd_render( osd );
+
+  ghosd_main_iterations( osd );
 }
 
 
@@ -295,12 +310,14 @@ aosd_osd_create ( void )
   osd_data->fade_data.height = layout_height + pad_top + pad_bottom;
   osd_data->fade_data.alpha = 0;
   osd_data->fade_data.deco_code = osd_data->cfg_osd->decoration.code;
+  osd_data->fade_data.by_opacity = ghosd_can_fade_by_opacity( osd );
   osd_data->dalpha_in = 1.0 / ( osd_data->cfg_osd->animation.timing_fadein / (gfloat)AOSD_TIMING );
   osd_data->dalpha_out = 1.0 / ( osd_data->cfg_osd->animation.timing_fadeout / (gfloat)AOSD_TIMING );
   osd_data->ddisplay_stay = 1.0 / ( osd_data->cfg_osd->animation.timing_display / (gfloat)AOSD_TIMING );
   ghosd_set_render( osd , (GhosdRenderFunc)aosd_fade_func , &(osd_data->fade_data) , NULL );
 
   /* show the osd (with alpha 0, invisible) */
+  ghosd_set_opacity( osd , osd_data->fade_data.by_opacity ? 0.0 : 1.0 );
   ghosd_show( osd );
   return;
 }
@@ -319,16 +336,14 @@ aosd_timer_func ( gpointer none )
       osd_data->fade_data.alpha += osd_data->dalpha_in;
       if ( osd_data->fade_data.alpha < 1.0 )
       {
-        ghosd_render( osd );
-        ghosd_main_iterations( osd );
+        aosd_fade_update();
       }
       else
       {
         osd_data->fade_data.alpha = 1.0;
         display_time = 0;
         osd_status = AOSD_STATUS_SHOW; /* move to next phase */
-        ghosd_render( osd );
-        ghosd_main_iterations( osd );
+        aosd_fade_update();
       }
       return TRUE;
     }
@@ -354,15 +369,13 @@ aosd_timer_func ( gpointer none )
       osd_data->fade_data.alpha -= osd_data->dalpha_out;
       if ( osd_data->fade_data.alpha > 0.0 )
       {
-        ghosd_render( osd );
-        ghosd_main_iterations( osd );
+        aosd_fade_update();
       }
       else
       {
         osd_data->fade_data.alpha = 0.0;
         osd_status = AOSD_STATUS_DESTROY; /* move to next phase */
-        ghosd_render( osd );
-        ghosd_main_iterations( osd );
+        aosd_fade_update();
       }
       return TRUE;
     }
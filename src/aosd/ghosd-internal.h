@@ -28,6 +28,15 @@ typedef struct {
   int set;
 } GhosdBackground;
 
+/* window contents, kept between renders so that a fade step does not need
+ * a new pixmap, GC and cairo surface */
+typedef struct {
+  Pixmap pixmap;
+  GC gc;
+  cairo_surface_t *surface;
+  int width, height;
+} GhosdBacking;
+
 struct _Ghosd {
   Display *dpy;
   Window win;
@@ -41,6 +50,7 @@ struct _Ghosd {
   int x, y, width, height;
 
   GhosdBackground background;
+  GhosdBacking backing;
   RenderCallback render;
   EventButtonCallback eventbutton;
 };
@@ -128,70 +128,118 @@ take_snapshot(Ghosd *ghosd) {
   return pixmap;
 }
 
-void
-ghosd_render(Ghosd *ghosd) {
-  Pixmap pixmap;
-  GC gc;
+static void
+backing_free(Ghosd *ghosd) {
+  GhosdBacking *b = &ghosd->backing;
+
+  if (b->surface != NULL)
+    cairo_surface_destroy(b->surface);
+  if (b->gc != NULL)
+    XFreeGC(ghosd->dpy, b->gc);
+  if (b->pixmap != None)
+  {
+    XSetWindowBackgroundPixmap(ghosd->dpy, ghosd->win, None);
+    XFreePixmap(ghosd->dpy, b->pixmap);
+  }
+
+  b->surface = NULL;
+  b->gc = NULL;
+  b->pixmap = None;
+  b->width = b->height = 0;
+}
+
+/* (re)creates the backing pixmap and its cairo surface when the window size
+ * has changed; the pixmap also serves as window background for exposures */
+static void
+backing_update(Ghosd *ghosd) {
+  GhosdBacking *b = &ghosd->backing;
+  XRenderPictFormat *xrformat;
+  int depth, screen;
+  Visual *visual;
+
+  if (b->pixmap != None && b->width == ghosd->width && b->height == ghosd->height)
+    return;
+
+  backing_free(ghosd);
 
   if (ghosd->composite)
   {
-    pixmap = XCreatePixmap(ghosd->dpy, ghosd->win, ghosd->width, ghosd->height, 32);
-    gc = XCreateGC(ghosd->dpy, pixmap, 0, NULL);
-    XFillRectangle(ghosd->dpy, pixmap, gc,
-      0, 0, ghosd->width, ghosd->height);
+    depth = 32;
+    screen = ghosd->screen_num;
+    visual = ghosd->visual;
   }
   else
   {
-    pixmap = XCreatePixmap(ghosd->dpy, ghosd->win, ghosd->width, ghosd->height,
-      DefaultDepth(ghosd->dpy, DefaultScreen(ghosd->dpy)));
-    gc = XCreateGC(ghosd->dpy, pixmap, 0, NULL);
-    if (ghosd->transparent) {
-      /* make our own copy of the background pixmap as the initial surface. */
-      XCopyArea(ghosd->dpy, ghosd->background.pixmap, pixmap, gc,
-        0, 0, ghosd->width, ghosd->height, 0, 0);
-    } else {
-      XFillRectangle(ghosd->dpy, pixmap, gc,
-        0, 0, ghosd->width, ghosd->height);
-    }
+    screen = DefaultScreen(ghosd->dpy);
+    depth = DefaultDepth(ghosd->dpy, screen);
+    visual = DefaultVisual(ghosd->dpy, screen);
   }
-  XFreeGC(ghosd->dpy, gc);
+
+  b->pixmap = XCreatePixmap(ghosd->dpy, ghosd->win, ghosd->width, ghosd->height, depth);
+  b->gc = XCreateGC(ghosd->dpy, b->pixmap, 0, NULL);
+  b->width = ghosd->width;
+  b->height = ghosd->height;
+
+  xrformat = XRenderFindVisualFormat(ghosd->dpy, visual);
+  b->surface = cairo_xlib_surface_create_with_xrender_format(
+                 ghosd->dpy, b->pixmap, ScreenOfDisplay(ghosd->dpy, screen),
+                 xrformat, b->width, b->height);
+
+  XSetWindowBackgroundPixmap(ghosd->dpy, ghosd->win, b->pixmap);
+}
+
+void
+ghosd_render(Ghosd *ghosd) {
+  GhosdBacking *b;
+
+  backing_update(ghosd);
+  b = &ghosd->backing;
+
+  if (!ghosd->composite && ghosd->transparent) {
+    /* start from our copy of the screen behind the window. */
+    XCopyArea(ghosd->dpy, ghosd->background.pixmap, b->pixmap, b->gc,
+      0, 0, b->width, b->height, 0, 0);
+  } else {
+    XFillRectangle(ghosd->dpy, b->pixmap, b->gc, 0, 0, b->width, b->height);
+  }
+  cairo_surface_mark_dirty(b->surface);
 
   /* render with cairo. */
   if (ghosd->render.func) {
-    /* create cairo surface using the pixmap. */
-    XRenderPictFormat *xrformat;
-    cairo_surface_t *surf;
-    if (ghosd->composite) {
-      xrformat = XRenderFindVisualFormat(ghosd->dpy, ghosd->visual);
-      surf = cairo_xlib_surface_create_with_xrender_format(
-               ghosd->dpy, pixmap,
-               ScreenOfDisplay(ghosd->dpy, ghosd->screen_num),
-               xrformat, ghosd->width, ghosd->height);
-    } else {
-      xrformat = XRenderFindVisualFormat(ghosd->dpy,
-                   DefaultVisual(ghosd->dpy, DefaultScreen(ghosd->dpy)));
-      surf = cairo_xlib_surface_create_with_xrender_format(
-               ghosd->dpy, pixmap,
-               ScreenOfDisplay(ghosd->dpy, DefaultScreen(ghosd->dpy)),
-               xrformat, ghosd->width, ghosd->height);
-    }
-
-    /* draw some stuff. */
-    cairo_t *cr = cairo_create(surf);
+    cairo_t *cr = cairo_create(b->surface);
     ghosd->render.func(ghosd, cr, ghosd->render.data);
     cairo_destroy(cr);
-    cairo_surface_destroy(surf);
+    cairo_surface_flush(b->surface);
   }
 
-  /* point window at its new backing pixmap. */
-  XSetWindowBackgroundPixmap(ghosd->dpy, ghosd->win, pixmap);
-  /* I think it's ok to free it here because XCreatePixmap(3X11) says: "the X
-   * server frees the pixmap storage when there are no references to it".
-   */
-  XFreePixmap(ghosd->dpy, pixmap);
+  /* and put the result on screen. */
+  XCopyArea(ghosd->dpy, b->pixmap, ghosd->win, b->gc,
+    0, 0, b->width, b->height, 0, 0);
+}
 
-  /* and tell the window to redraw with this pixmap. */
-  XClearWindow(ghosd->dpy, ghosd->win);
+void
+ghosd_set_opacity(Ghosd *ghosd, double opacity) {
+  Atom opacity_atom = XInternAtom(ghosd->dpy, "_NET_WM_WINDOW_OPACITY", False);
+
+  if (opacity >= 1.0)
+  {
+    XDeleteProperty(ghosd->dpy, ghosd->win, opacity_atom);
+  }
+  else
+  {
+    unsigned long value = (opacity > 0) ? (unsigned long) (opacity * 0xffffffffUL) : 0;
+    XChangeProperty(ghosd->dpy, ghosd->win, opacity_atom, XA_CARDINAL, 32,
+                    PropModeReplace, (unsigned char *) &value, 1);
+  }
+}
+
+int
+ghosd_can_fade_by_opacity(Ghosd *ghosd) {
+#ifdef HAVE_XCOMPOSITE
+  return ghosd->composite && composite_find_manager(ghosd->dpy, ghosd->screen_num);
+#else
+  return 0;
+#endif
 }
 
 static void
@@ -484,6 +532,7 @@ ghosd_check_composite_mgr(void)
 
 void
 ghosd_destroy(Ghosd* ghosd) {
+  backing_free(ghosd);
   if (ghosd->background.set)
   {
     XFreePixmap(ghosd->dpy, ghosd->background.pixmap);
@@ -26,8 +26,13 @@
 #include <math.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <gtk/gtk.h>
 
+#include <audacious/debug.h>
 #include <audacious/i18n.h>
 #include <audacious/misc.h>
 #include <audacious/plugin.h>
@@ -37,6 +42,7 @@
 
 #define D_WIDTH 64
 #define D_HEIGHT 32
+#define FRAME_REPORT 500 /* frames between timing reports */
 
 static gboolean bscope_init (void);
 static void bscope_cleanup(void);
@@ -68,6 +74,12 @@ AUD_VIS_PLUGIN
 static GtkWidget * area = NULL;
 static gint width, height, stride, image_size;
 static guint32 * image = NULL, * corner = NULL;
+static guint32 * blur_rows = NULL; /* two rows of width pixels */
+static cairo_surface_t * surface = NULL;
+
+static GTimer * frame_timer = NULL;
+static gint frames_drawn, frames_skipped;
+static gdouble frame_time;
 
 static const gchar * const bscope_defaults[] = {
  "color", "16727935", /* 0xFF3F7F */
@@ -80,6 +92,10 @@ static gboolean bscope_init (void)
     aud_config_set_defaults ("BlurScope", bscope_defaults);
     color = aud_get_int ("BlurScope", "color");
 
+    frame_timer = g_timer_new ();
+    frames_drawn = frames_skipped = 0;
+    frame_time = 0;
+
     return TRUE;
 }
 
@@ -87,12 +103,26 @@ static void bscope_cleanup (void)
 {
     aud_set_int ("BlurScope", "color", color);
 
+    if (surface)
+    {
+        cairo_surface_destroy (surface);
+        surface = NULL;
+    }
+
     g_free (image);
     image = NULL;
+    g_free (blur_rows);
+    blur_rows = NULL;
+
+    g_timer_destroy (frame_timer);
+    frame_timer = NULL;
 }
 
 static void bscope_resize (gint w, gint h)
 {
+    if (surface)
+        cairo_surface_destroy (surface);
+
     width = w;
     height = h;
     stride = width + 2;
@@ -100,15 +130,30 @@ static void bscope_resize (gint w, gint h)
     image = g_realloc (image, image_size);
     memset (image, 0, image_size);
     corner = image + stride + 1;
+    blur_rows = g_realloc (blur_rows, sizeof (guint32) * 2 * width);
+
+    surface = cairo_image_surface_create_for_data ((guchar *) image,
+     CAIRO_FORMAT_RGB24, width, height, stride << 2);
 }
 
 static void bscope_draw_to_cairo (cairo_t * cr)
 {
-    cairo_surface_t * surf = cairo_image_surface_create_for_data ((guchar *)
-     image, CAIRO_FORMAT_RGB24, width, height, stride << 2);
-    cairo_set_source_surface (cr, surf, 0, 0);
+    cairo_surface_mark_dirty (surface);
+    cairo_set_source_surface (cr, surface, 0, 0);
     cairo_paint (cr);
-    cairo_surface_destroy (surf);
+}
+
+/* There is no point in rendering while the widget is unmapped or its window
+ * is minimized; the image simply picks up again when it is shown. */
+static gboolean bscope_visible (void)
+{
+    if (! area || ! gtk_widget_is_drawable (area))
+        return FALSE;
+
+    GdkWindow * top = gtk_widget_get_window (gtk_widget_get_toplevel (area));
+
+    return top && ! (gdk_window_get_state (top) & (GDK_WINDOW_STATE_ICONIFIED |
+     GDK_WINDOW_STATE_WITHDRAWN));
 }
 
 static void bscope_draw (void)
@@ -156,22 +201,50 @@ static void bscope_clear (void)
     bscope_draw ();
 }
 
+/* Each row is blurred into a separate buffer and copied back afterwards, so
+ * that every pixel is computed from the unblurred image, whether four at a
+ * time or one by one.  The unblurred copy of the row above is kept aside. */
 static void bscope_blur (void)
 {
+    guint32 * out = blur_rows;
+    guint32 * last = blur_rows + width;
+
     for (gint y = 0; y < height; y ++)
     {
-        guint32 * p = corner + stride * y;
+        guint32 * row = corner + stride * y;
+        guint32 * p = row;
         guint32 * end = p + width;
-        guint32 * plast = p - stride;
+        guint32 * plast = y ? last : p - stride;
         guint32 * pnext = p + stride;
+        guint32 * q = out;
 
         /* We do a quick and dirty average of four color values, first masking
          * off the lowest two bits.  Over a large area, this masking has the net
          * effect of subtracting 1.5 from each value, which by a happy chance
          * is just right for a gradual fade effect. */
+#ifdef __SSE2__
+        const __m128i mask = _mm_set1_epi32 (0xFCFCFC);
+
+        for (; p + 4 <= end; p += 4, plast += 4, pnext += 4, q += 4)
+        {
+            __m128i sum = _mm_add_epi32 (
+             _mm_add_epi32 (
+              _mm_and_si128 (_mm_loadu_si128 ((const __m128i *) plast), mask),
+              _mm_and_si128 (_mm_loadu_si128 ((const __m128i *) (p - 1)), mask)),
+             _mm_add_epi32 (
+              _mm_and_si128 (_mm_loadu_si128 ((const __m128i *) (p + 1)), mask),
+              _mm_and_si128 (_mm_loadu_si128 ((const __m128i *) pnext), mask)));
+
+            _mm_storeu_si128 ((__m128i *) q, _mm_srli_epi32 (sum, 2));
+        }
+#endif
+
         for (; p < end; p ++)
-            * p = ((* plast ++ & 0xFCFCFC) + (p[-1] & 0xFCFCFC) + (p[1] &
+            * q ++ = ((* plast ++ & 0xFCFCFC) + (p[-1] & 0xFCFCFC) + (p[1] &
              0xFCFCFC) + (* pnext ++ & 0xFCFCFC)) >> 2;
+
+        memcpy (last, row, sizeof (guint32) * width);
+        memcpy (row, out, sizeof (guint32) * width);
     }
 }
 
@@ -189,8 +262,29 @@ static inline void draw_vert_line (gint x, guint y1, gint y2)
         * p = color;
 }
 
+static void bscope_report_frames (void)
+{
+    if (frames_drawn + frames_skipped < FRAME_REPORT)
+        return;
+
+    AUDDBG ("%d frames drawn (%.3f ms each), %d skipped.\n", frames_drawn,
+     frames_drawn ? frame_time * 1000 / frames_drawn : 0.0, frames_skipped);
+
+    frames_drawn = frames_skipped = 0;
+    frame_time = 0;
+}
+
 static void bscope_render (const gfloat * data)
 {
+    if (! bscope_visible ())
+    {
+        frames_skipped ++;
+        bscope_report_frames ();
+        return;
+    }
+
+    g_timer_start (frame_timer);
+
     bscope_blur ();
 
     gint prev_y = (0.5 + data[0]) * height;
@@ -205,6 +299,10 @@ static void bscope_render (const gfloat * data)
     }
 
     bscope_draw ();
+
+    frame_time += g_timer_elapsed (frame_timer, NULL);
+    frames_drawn ++;
+    bscope_report_frames ();
 }
 
 static void color_set_cb (GtkWidget * chooser)
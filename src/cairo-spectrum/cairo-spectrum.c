@@ -33,62 +33,73 @@
 
 #include "config.h"
 
+#include "../vis-common/spectrum.h"
+
 #define MAX_BANDS   (256)
 #define VIS_DELAY 2 /* delay before falloff in frames */
 #define VIS_FALLOFF 2 /* falloff in pixels per frame */
+#define FRAME_REPORT 500 /* frames between timing reports */
 
 static GtkWidget * spect_widget = NULL;
-static gfloat xscale[MAX_BANDS + 1];
+static SpectrumMap map;
 static gint width, height, bands;
 static gint bars[MAX_BANDS + 1];
 static gint delay[MAX_BANDS + 1];
 
-static void calculate_bands(gint bands_)
+/* one solid color per band, rebuilt only when the number of bands changes */
+static cairo_pattern_t * gradient = NULL;
+
+static GTimer * frame_timer = NULL;
+static gint frames_drawn, frames_skipped;
+static gdouble frame_time;
+
+static void report_frames (void)
 {
-    gint i;
+    if (frames_drawn + frames_skipped < FRAME_REPORT)
+        return;
+
+    AUDDBG ("%d frames drawn (%.3f ms each), %d skipped.\n", frames_drawn,
+     frames_drawn ? frame_time * 1000 / frames_drawn : 0.0, frames_skipped);
+
+    frames_drawn = frames_skipped = 0;
+    frame_time = 0;
+}
+
+static gboolean widget_visible (GtkWidget * widget)
+{
+    if (! gtk_widget_is_drawable (widget))
+        return FALSE;
+
+    GdkWindow * top = gtk_widget_get_window (gtk_widget_get_toplevel (widget));
 
-    for (i = 0; i < bands_; i++)
-        xscale[i] = powf(257., ((gfloat) i / (gfloat) bands_)) - 1;
+    return top && ! (gdk_window_get_state (top) & (GDK_WINDOW_STATE_ICONIFIED |
+     GDK_WINDOW_STATE_WITHDRAWN));
 }
 
 static void render_cb (gfloat * freq)
 {
     g_return_if_fail (spect_widget);
 
-    calculate_bands(bands);
+    /* skip the analysis too while the widget cannot be seen */
+    if (! widget_visible (spect_widget))
+    {
+        frames_skipped ++;
+        report_frames ();
+        return;
+    }
+
+    gfloat level[MAX_BANDS];
+
+    spectrum_map_set (& map, bands, 1);
+    spectrum_map_apply (& map, freq, level);
 
     for (gint i = 0; i < bands; i ++)
     {
-        gint a = ceil (xscale[i]);
-        gint b = floor (xscale[i + 1]);
-        gfloat n = 0;
-
-        if (b < a)
-            n += freq[b] * (xscale[i + 1] - xscale[i]);
-        else
-        {
-            if (a > 0)
-                n += freq[a - 1] * (a - xscale[i]);
-            for (; a < b; a ++)
-                n += freq[a];
-            if (b < 256)
-                n += freq[b] * (xscale[i + 1] - b);
-        }
-
         /* 40 dB range */
-        gint x = 20 * log10 (n * 100);
+        gint x = 20 * log10 (level[i] * 100);
         x = CLAMP (x, 0, 40);
 
-        bars[i] -= MAX (0, VIS_FALLOFF - delay[i]);
-
-        if (delay[i])
-            delay[i]--;
-
-        if (x > bars[i])
-        {
-            bars[i] = x;
-            delay[i] = VIS_DELAY;
-        }
+        spectrum_peak (x, & bars[i], & delay[i], VIS_DELAY, VIS_FALLOFF);
     }
 
     gtk_widget_queue_draw (spect_widget);
@@ -192,6 +203,29 @@ static void get_color (gint i, gfloat * r, gfloat * g, gfloat * b)
     hsv_to_rgb (h, s, v, r, g, b);
 }
 
+static void update_gradient (void)
+{
+    if (gradient)
+        cairo_pattern_destroy (gradient);
+
+    /* each band gets a pair of stops with the same color, so the color is
+     * constant across the bar and changes sharply between bars */
+    gint bar_width = width / bands;
+    gdouble length = 2 + bar_width * (bands + 1);
+
+    gradient = cairo_pattern_create_linear (0, 0, length, 0);
+
+    for (gint i = 0; i <= bands; i ++)
+    {
+        gfloat r, g, b;
+        get_color (i, & r, & g, & b);
+
+        gint x = bar_width * i + 2;
+        cairo_pattern_add_color_stop_rgb (gradient, x / length, r, g, b);
+        cairo_pattern_add_color_stop_rgb (gradient, (x + bar_width) / length, r, g, b);
+    }
+}
+
 static void draw_background (GtkWidget * area, cairo_t * cr)
 {
 #if 0
@@ -230,16 +264,20 @@ static void draw_visualizer (GtkWidget *widget, cairo_t *cr)
 {
     gfloat base_s = (height / 40);
 
+    if (! gradient)
+        update_gradient ();
+
+    /* all the bars are filled at once */
     for (gint i = 0; i <= bands; i++)
     {
         gint x = ((width / bands) * i) + 2;
-        gfloat r, g, b;
 
-        get_color (i, & r, & g, & b);
-        cairo_set_source_rgb (cr, r, g, b);
-        cairo_rectangle (cr, x + 1, height - (bars[i] * base_s), (width / bands) - 1, (bars[i] * base_s));
-        cairo_fill (cr);
+        if (bars[i])
+            cairo_rectangle (cr, x + 1, height - (bars[i] * base_s), (width / bands) - 1, (bars[i] * base_s));
     }
+
+    cairo_set_source (cr, gradient);
+    cairo_fill (cr);
 }
 
 static gboolean configure_event (GtkWidget * widget, GdkEventConfigure * event)
@@ -250,13 +288,15 @@ static gboolean configure_event (GtkWidget * widget, GdkEventConfigure * event)
 
     bands = width / 10;
     bands = CLAMP(bands, 12, MAX_BANDS);
-    calculate_bands(bands);
+
+    update_gradient ();
 
     return TRUE;
 }
 
 static gboolean draw_event (GtkWidget * widget, cairo_t * cr, GtkWidget * area)
 {
+    g_timer_start (frame_timer);
 
     draw_background (widget, cr);
     draw_visualizer (widget, cr);
@@ -264,6 +304,10 @@ static gboolean draw_event (GtkWidget * widget, cairo_t * cr, GtkWidget * area)
     draw_grid (widget, cr);
 #endif
 
+    frame_time += g_timer_elapsed (frame_timer, NULL);
+    frames_drawn ++;
+    report_frames ();
+
     return TRUE;
 }
 
@@ -271,6 +315,17 @@ static gboolean destroy_event (void)
 {
     aud_vis_func_remove ((VisFunc) render_cb);
     spect_widget = NULL;
+    spectrum_map_free (& map);
+
+    if (gradient)
+    {
+        cairo_pattern_destroy (gradient);
+        gradient = NULL;
+    }
+
+    g_timer_destroy (frame_timer);
+    frame_timer = NULL;
+
     return TRUE;
 }
 
@@ -279,6 +334,10 @@ static /* GtkWidget * */ gpointer get_widget(void)
     GtkWidget *area = gtk_drawing_area_new();
     spect_widget = area;
 
+    frame_timer = g_timer_new ();
+    frames_drawn = frames_skipped = 0;
+    frame_time = 0;
+
     g_signal_connect(area, "draw", (GCallback) draw_event, NULL);
     g_signal_connect(area, "configure-event", (GCallback) configure_event, NULL);
     g_signal_connect(area, "destroy", (GCallback) destroy_event, NULL);
@@ -8,10 +8,14 @@
 
 #include "config.h"
 #include <math.h>
+#include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
 
 extern "C" {
 #include <libaudcore/audstrings.h>
+#include <audacious/debug.h>
+#include <audacious/misc.h>
 #include <audacious/plugin.h>
 }
 
@@ -153,6 +157,242 @@ gint ConsoleFileHandler::load(gint sample_rate)
     return 0;
 }
 
+/* Length detection for tracks without timing information.  Each subtune is
+ * run at full speed on a worker thread until the emulator's silence detection
+ * ends it; tracks that are still playing after the default length are assumed
+ * to loop forever.  Results are keyed by the MD5 of the file and the track
+ * number and are kept in a small text file, so each file is scanned only once.
+ * The hashes of local files are remembered by path, size and modification
+ * time, so that probing and playing do not read the whole file again.
+ */
+
+#define SCAN_PENDING -1
+
+static const gint scan_rate = 22050;
+
+struct HashEntry {
+    gint64 size;
+    gint64 mtime;
+    gchar hash[33];
+};
+
+struct ScanJob {
+    gchar *path;
+    gchar *key;
+    gint track;
+};
+
+static GMutex *length_mutex = NULL;
+static GCond *length_cond = NULL;
+static GHashTable *lengths = NULL;   // key -> length in ms, 0 if the track never ends
+static GHashTable *hashes = NULL;    // path -> HashEntry, guarded by length_mutex
+static GThreadPool *scan_pool = NULL;
+static volatile gboolean scan_abort = FALSE;
+
+static gchar *lengths_filename()
+{
+    return g_build_filename(aud_get_path(AUD_PATH_USER_DIR), "console-lengths", NULL);
+}
+
+static void lengths_load()
+{
+    gchar *filename = lengths_filename();
+    FILE *file = fopen(filename, "r");
+    g_free(filename);
+
+    if (file == NULL)
+        return;
+
+    gchar hash[33];
+    gint track, length;
+
+    while (fscanf(file, "%32s %d %d\n", hash, &track, &length) == 3)
+    {
+        if (length >= 0)
+            g_hash_table_insert(lengths, g_strdup_printf("%s/%d", hash, track),
+             GINT_TO_POINTER(length));
+    }
+
+    fclose(file);
+}
+
+// called with length_mutex held
+static void lengths_append(const gchar *key, gint length)
+{
+    gchar *filename = lengths_filename();
+    FILE *file = fopen(filename, "a");
+    g_free(filename);
+
+    if (file == NULL)
+        return;
+
+    const gchar *slash = strrchr(key, '/');
+    fprintf(file, "%.*s %s %d\n", (int) (slash - key), key, slash + 1, length);
+    fclose(file);
+}
+
+static gchar *file_hash(const gchar *path)
+{
+    // only local files have a modification time to check against
+    struct stat st;
+    gchar *filename = uri_to_filename(path);
+    gboolean local = (filename != NULL && stat(filename, &st) == 0);
+    g_free(filename);
+
+    if (local)
+    {
+        g_mutex_lock(length_mutex);
+        HashEntry *entry = (HashEntry *) g_hash_table_lookup(hashes, path);
+        gchar *hash = (entry != NULL && entry->size == (gint64) st.st_size &&
+         entry->mtime == (gint64) st.st_mtime) ? g_strdup(entry->hash) : NULL;
+        g_mutex_unlock(length_mutex);
+
+        if (hash != NULL)
+            return hash;
+    }
+
+    void *data = NULL;
+    gint64 size = 0;
+
+    vfs_file_get_contents(path, &data, &size);
+    if (data == NULL)
+        return NULL;
+
+    gchar *hash = g_compute_checksum_for_data(G_CHECKSUM_MD5, (const guchar *) data, size);
+    g_free(data);
+
+    if (local && size == (gint64) st.st_size)
+    {
+        HashEntry *entry = g_new(HashEntry, 1);
+        entry->size = size;
+        entry->mtime = st.st_mtime;
+        g_strlcpy(entry->hash, hash, sizeof entry->hash);
+
+        g_mutex_lock(length_mutex);
+        g_hash_table_replace(hashes, g_strdup(path), entry);
+        g_mutex_unlock(length_mutex);
+    }
+
+    return hash;
+}
+
+// Plays the track silently and returns the time of the last audible sample,
+// or 0 if it did not end within the default track length.
+static gint scan_length(const gchar *path, gint track)
+{
+    ConsoleFileHandler fh(path);
+
+    if (fh.load(fh.m_type == gme_spc_type ? 32000 : scan_rate))
+        return 0;
+
+    Music_Emu *emu = fh.m_emu;
+    if (log_err(emu->start_track(track)))
+        return 0;
+
+    gint const buf_size = 2048;
+    Music_Emu::sample_t buf[buf_size];
+    gint64 const limit = (gint64) audcfg.loop_length * emu->sample_rate() * 2;
+    gint64 pos = 0, last_sound = 0;
+
+    while (!emu->track_ended() && pos < limit && !scan_abort)
+    {
+        if (log_err(emu->play(buf_size, buf)))
+            return 0;
+
+        for (gint i = buf_size; i --; )
+        {
+            if ((unsigned) (buf[i] + 8) > 16)
+            {
+                last_sound = pos + i + 1;
+                break;
+            }
+        }
+
+        pos += buf_size;
+    }
+
+    if (!emu->track_ended())
+        return 0;
+
+    return last_sound * 1000 / (emu->sample_rate() * 2);
+}
+
+static void scan_worker(gpointer data, gpointer user)
+{
+    ScanJob *job = (ScanJob *) data;
+    gint length = scan_abort ? 0 : scan_length(job->path, job->track);
+
+    AUDDBG("console: %s track %d: %d ms\n", job->path, job->track + 1, length);
+
+    g_mutex_lock(length_mutex);
+
+    if (!scan_abort)
+        lengths_append(job->key, length);
+
+    // the table already holds an equal key, so this frees job->key
+    g_hash_table_insert(lengths, job->key, GINT_TO_POINTER(length));
+
+    g_cond_broadcast(length_cond);
+    g_mutex_unlock(length_mutex);
+
+    g_free(job->path);
+    g_free(job);
+}
+
+// Returns the detected length of a track in ms, or 0 if there is none (yet).
+// Queues all tracks of the file for scanning on first use.
+static gint detected_length(const gchar *path, gint track_count, gint track, gboolean wait)
+{
+    if (audcfg.loop_length <= 0)
+        return 0;
+
+    gchar *hash = file_hash(path);
+    if (hash == NULL)
+        return 0;
+
+    gchar *key = g_strdup_printf("%s/%d", hash, track);
+    gpointer value;
+
+    g_mutex_lock(length_mutex);
+
+    if (!g_hash_table_lookup_extended(lengths, key, NULL, NULL))
+    {
+        for (gint i = 0; i < track_count; i ++)
+        {
+            gchar *k = g_strdup_printf("%s/%d", hash, i);
+
+            if (g_hash_table_lookup_extended(lengths, k, NULL, NULL))
+            {
+                g_free(k);
+                continue;
+            }
+
+            g_hash_table_insert(lengths, g_strdup(k), GINT_TO_POINTER(SCAN_PENDING));
+
+            ScanJob *job = g_new(ScanJob, 1);
+            job->path = g_strdup(path);
+            job->key = k;
+            job->track = i;
+            g_thread_pool_push(scan_pool, job, NULL);
+        }
+    }
+
+    while ((value = g_hash_table_lookup(lengths, key)) == GINT_TO_POINTER(SCAN_PENDING) && wait)
+        g_cond_wait(length_cond, length_mutex);
+
+    g_mutex_unlock(length_mutex);
+
+    g_free(key);
+    g_free(hash);
+
+    return GPOINTER_TO_INT(value) > 0 ? GPOINTER_TO_INT(value) : 0;
+}
+
+static inline gboolean has_length(const track_info_t *info)
+{
+    return info->length > 0 || info->intro_length + 2 * info->loop_length > 0;
+}
+
 static inline void set_str (Tuple * tuple, int field, const char * str)
 {
     char * valid = str_to_utf8 (str);
@@ -206,7 +446,14 @@ extern "C" Tuple * console_probe_for_tuple(const gchar *filename, VFSFile *fd)
     {
         track_info_t info;
         if (!log_err(fh.m_emu->track_info(&info, fh.m_track < 0 ? 0 : fh.m_track)))
+        {
+            // the subtunes are probed one by one later, so only start scanning here
+            if (!has_length(&info))
+                info.length = detected_length(fh.m_path, info.track_count,
+                 fh.m_track < 0 ? 0 : fh.m_track, fh.m_track >= 0);
+
             return get_track_ti(fh.m_path, &info, fh.m_track);
+        }
     }
 
     return NULL;
@@ -266,6 +513,9 @@ extern "C" gboolean console_play(InputPlayback *playback, const gchar *filename,
         if (fh.m_type == gme_spc_type && audcfg.ignore_spc_length)
             info.length = -1;
 
+        if (!has_length(&info))
+            info.length = detected_length(fh.m_path, info.track_count, fh.m_track, FALSE);
+
         Tuple *ti = get_track_ti(fh.m_path, &info, fh.m_track);
         if (ti != NULL)
         {
@@ -383,11 +633,29 @@ extern "C" gboolean console_init (void)
     console_cfg_load();
     seek_mutex = g_mutex_new();
     seek_cond = g_cond_new();
+
+    length_mutex = g_mutex_new();
+    length_cond = g_cond_new();
+    lengths = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    lengths_load();
+    hashes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    scan_abort = FALSE;
+    scan_pool = g_thread_pool_new(scan_worker, NULL, g_get_num_processors(), FALSE, NULL);
     return TRUE;
 }
 
 extern "C" void console_cleanup(void)
 {
+    // let queued jobs run to completion; they return at once
+    scan_abort = TRUE;
+    g_thread_pool_free(scan_pool, FALSE, TRUE);
+
+    g_hash_table_destroy(lengths);
+    g_hash_table_destroy(hashes);
+    g_mutex_free(length_mutex);
+    g_cond_free(length_cond);
+
     g_mutex_free(seek_mutex);
     g_cond_free(seek_cond);
 }
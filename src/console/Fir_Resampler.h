@@ -7,6 +7,10 @@
 #include "blargg_common.h"
 #include <string.h>
 
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+
 class Fir_Resampler_ {
 public:
 	
@@ -124,6 +128,30 @@ int Fir_Resampler<width>::read( sample_t* out_begin, blargg_long count )
 			if ( count < 0 )
 				break;
 			
+		#ifdef __SSE2__
+			if ( width % 4 == 0 )
+			{
+				// Four taps per step. Input L R L R L R L R is reordered to
+				// L L R R L L R R and the taps to k0 k1 k0 k1 k2 k3 k2 k3, so each
+				// madd lane holds two taps of one channel: l r l r.
+				__m128i sum = _mm_setzero_si128();
+				for ( int n = width / 4; n; --n )
+				{
+					__m128i x = _mm_loadu_si128( (__m128i const*) i );
+					x = _mm_shufflelo_epi16( x, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+					x = _mm_shufflehi_epi16( x, _MM_SHUFFLE( 3, 1, 2, 0 ) );
+					__m128i k = _mm_loadl_epi64( (__m128i const*) imp );
+					k = _mm_unpacklo_epi32( k, k );
+					sum = _mm_add_epi32( sum, _mm_madd_epi16( x, k ) );
+					imp += 4;
+					i += 8;
+				}
+				sum = _mm_add_epi32( sum, _mm_srli_si128( sum, 8 ) );
+				l = _mm_cvtsi128_si32( sum );
+				r = _mm_cvtsi128_si32( _mm_srli_si128( sum, 4 ) );
+			}
+			else
+		#endif
 			for ( int n = width / 2; n; --n )
 			{
 				int pt0 = imp [0];
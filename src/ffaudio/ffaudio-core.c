@@ -36,11 +36,25 @@
 #include <audacious/audtag.h>
 #include <libaudcore/audstrings.h>
 
-static GMutex *ctrl_mutex = NULL;
-static gint64 seek_value = -1;
-static gboolean stop_flag = FALSE;
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Bytes and time read by avformat_find_stream_info at most */
+#define PROBE_SIZE (256 * 1024)
+#define PROBE_DURATION (AV_TIME_BASE / 2)
+
+/* Control state of one playback, reached through playback->get_data() */
+typedef struct {
+    GMutex * mutex;
+    gint64 seek_value;
+    gboolean stop_flag;
+} ffaudio_playback_t;
+
+/* Only guards attaching and detaching playback contexts */
+static GStaticMutex ctx_mutex = G_STATIC_MUTEX_INIT;
 
-static GStaticMutex data_mutex = G_STATIC_MUTEX_INIT;
+/* Built once in ffaudio_init(), read-only afterwards */
 static GHashTable * extension_dict = NULL;
 
 /* str_unref() may be a macro */
@@ -70,12 +84,14 @@ static gint lockmgr (void * * mutexp, enum AVLockOp op)
     return 0;
 }
 
+static GHashTable * create_extension_dict (void);
+
 static gboolean ffaudio_init (void)
 {
     av_register_all();
     av_lockmgr_register (lockmgr);
 
-    ctrl_mutex = g_mutex_new();
+    extension_dict = create_extension_dict ();
 
     return TRUE;
 }
@@ -84,10 +100,9 @@ static void
 ffaudio_cleanup(void)
 {
     AUDDBG("cleaning up\n");
-    g_mutex_free(ctrl_mutex);
 
-    if (extension_dict)
-        g_hash_table_destroy (extension_dict);
+    g_hash_table_destroy (extension_dict);
+    extension_dict = NULL;
 
     av_lockmgr_register (NULL);
 }
@@ -141,13 +156,7 @@ static AVInputFormat * get_format_by_extension (const gchar * name)
     gchar * ext = g_ascii_strdown (ext0 + 1, sub - ext0 - 1);
 
     AUDDBG ("Get format by extension: %s\n", name);
-    g_static_mutex_lock (& data_mutex);
-
-    if (! extension_dict)
-        extension_dict = create_extension_dict ();
-
     AVInputFormat * f = g_hash_table_lookup (extension_dict, ext);
-    g_static_mutex_unlock (& data_mutex);
 
     if (f)
         AUDDBG ("Format %s.\n", f->name);
@@ -224,6 +233,10 @@ static AVFormatContext * open_input_file (const gchar * name, VFSFile * file)
     AVIOContext * io = io_context_new (file);
     c->pb = io;
 
+    /* bound the stream analysis done by avformat_find_stream_info */
+    c->probesize = PROBE_SIZE;
+    c->max_analyze_duration = PROBE_DURATION;
+
     gint ret = avformat_open_input (& c, name, f, NULL);
 
     if (ret < 0)
@@ -236,6 +249,24 @@ static AVFormatContext * open_input_file (const gchar * name, VFSFile * file)
     return c;
 }
 
+/* Returns the index of the first audio stream with a known decoder, or -1 */
+static gint find_audio_stream (AVFormatContext * ic, AVCodec * * codec)
+{
+    avformat_find_stream_info (ic, NULL);
+
+    for (gint i = 0; i < ic->nb_streams; i ++)
+    {
+        AVCodecContext * c = ic->streams[i]->codec;
+
+        if (c->codec_type == AVMEDIA_TYPE_AUDIO &&
+         (* codec = avcodec_find_decoder (c->codec_id)) != NULL)
+            return i;
+    }
+
+    * codec = NULL;
+    return -1;
+}
+
 static void close_input_file (AVFormatContext * c)
 {
     AVIOContext * io = c->pb;
@@ -267,6 +298,90 @@ ffaudio_codec_is_seekable(AVCodec *codec)
     }
 }
 
+/* Interleaves planar samples of the given size (1, 2 or 4 bytes) into out.
+ * Stereo, by far the most common case, is done 4 or 8 samples at a time. */
+static void interleave (void * out, guint8 * const * planes, gint channels,
+ gint samples, gint size)
+{
+    gint i = 0, c;
+
+    if (channels == 2 && size == 4)
+    {
+        const gint32 * l = (const gint32 *) planes[0], * r = (const gint32 *) planes[1];
+        gint32 * o = out;
+
+#ifdef __SSE2__
+        for (; i + 4 <= samples; i += 4)
+        {
+            __m128i a = _mm_loadu_si128 ((const __m128i *) (l + i));
+            __m128i b = _mm_loadu_si128 ((const __m128i *) (r + i));
+            _mm_storeu_si128 ((__m128i *) (o + 2 * i), _mm_unpacklo_epi32 (a, b));
+            _mm_storeu_si128 ((__m128i *) (o + 2 * i + 4), _mm_unpackhi_epi32 (a, b));
+        }
+#endif
+
+        for (; i < samples; i ++)
+        {
+            o[2 * i] = l[i];
+            o[2 * i + 1] = r[i];
+        }
+    }
+    else if (channels == 2 && size == 2)
+    {
+        const gint16 * l = (const gint16 *) planes[0], * r = (const gint16 *) planes[1];
+        gint16 * o = out;
+
+#ifdef __SSE2__
+        for (; i + 8 <= samples; i += 8)
+        {
+            __m128i a = _mm_loadu_si128 ((const __m128i *) (l + i));
+            __m128i b = _mm_loadu_si128 ((const __m128i *) (r + i));
+            _mm_storeu_si128 ((__m128i *) (o + 2 * i), _mm_unpacklo_epi16 (a, b));
+            _mm_storeu_si128 ((__m128i *) (o + 2 * i + 8), _mm_unpackhi_epi16 (a, b));
+        }
+#endif
+
+        for (; i < samples; i ++)
+        {
+            o[2 * i] = l[i];
+            o[2 * i + 1] = r[i];
+        }
+    }
+    else if (size == 4)
+    {
+        for (c = 0; c < channels; c ++)
+        {
+            const gint32 * p = (const gint32 *) planes[c];
+            gint32 * o = (gint32 *) out + c;
+
+            for (i = 0; i < samples; i ++)
+                o[i * channels] = p[i];
+        }
+    }
+    else if (size == 2)
+    {
+        for (c = 0; c < channels; c ++)
+        {
+            const gint16 * p = (const gint16 *) planes[c];
+            gint16 * o = (gint16 *) out + c;
+
+            for (i = 0; i < samples; i ++)
+                o[i * channels] = p[i];
+        }
+    }
+    else
+    {
+        for (c = 0; c < channels; c ++)
+        {
+            const guint8 * p = planes[c];
+            guint8 * o = (guint8 *) out + c;
+
+            for (i = 0; i < samples; i ++)
+                o[i * channels] = p[i];
+        }
+    }
+}
+
 static gboolean ffaudio_probe (const gchar * filename, VFSFile * file)
 {
     if (! file)
@@ -347,25 +462,14 @@ static Tuple * read_tuple (const gchar * filename, VFSFile * file)
 {
     AVCodec *codec = NULL;
     AVCodecContext *c = NULL;
-    AVStream *s = NULL;
-    gint i;
 
     AVFormatContext * ic = open_input_file (filename, file);
     if (! ic)
         return NULL;
 
-    for (i = 0; i < ic->nb_streams; i++)
-    {
-        s = ic->streams[i];
-        c = s->codec;
-        if (c->codec_type == AVMEDIA_TYPE_AUDIO)
-        {
-            avformat_find_stream_info (ic, NULL);
-            codec = avcodec_find_decoder(c->codec_id);
-            if (codec != NULL)
-                break;
-        }
-    }
+    gint stream_id = find_audio_stream (ic, & codec);
+    if (stream_id >= 0)
+        c = ic->streams[stream_id]->codec;
 
     Tuple *tuple = tuple_new_from_filename(filename);
     ffaudio_get_tuple_data(tuple, ic, c, codec);
@@ -410,38 +514,35 @@ static gboolean ffaudio_play (InputPlayback * playback, const gchar * filename,
 
     AVCodec *codec = NULL;
     AVCodecContext *c = NULL;
-    AVStream *s = NULL;
     AVPacket pkt = {.data = NULL};
-    gint i, stream_id, errcount;
+    gint stream_id, errcount;
     gboolean codec_opened = FALSE;
     gint out_fmt;
+    gboolean planar = FALSE;
     gboolean seekable;
     gboolean error = FALSE;
+    AVFrame * frame = NULL;
+    void * buf = NULL;
+    gint buf_size = 0;
+
+    ffaudio_playback_t ctx = {.seek_value = -1, .stop_flag = FALSE};
+    ctx.mutex = g_mutex_new ();
 
     AVFormatContext * ic = open_input_file (filename, file);
     if (! ic)
-        return FALSE;
-
-    for (i = 0; i < ic->nb_streams; i++)
     {
-        s = ic->streams[i];
-        c = s->codec;
-        if (c->codec_type == AVMEDIA_TYPE_AUDIO)
-        {
-            avformat_find_stream_info (ic, NULL);
-            codec = avcodec_find_decoder(c->codec_id);
-            stream_id = i;
-            if (codec != NULL)
-                break;
-        }
+        g_mutex_free (ctx.mutex);
+        return FALSE;
     }
 
-    if (codec == NULL)
+    if ((stream_id = find_audio_stream (ic, & codec)) < 0)
     {
         fprintf (stderr, "ffaudio: No codec found for %s.\n", filename);
         goto error_exit;
     }
 
+    c = ic->streams[stream_id]->codec;
+
     AUDDBG("got codec %s for stream index %d, opening\n", codec->name, stream_id);
 
     if (avcodec_open2 (c, codec, NULL) < 0)
@@ -454,6 +555,10 @@ static gboolean ffaudio_play (InputPlayback * playback, const gchar * filename,
         case AV_SAMPLE_FMT_S16: out_fmt = FMT_S16_NE; break;
         case AV_SAMPLE_FMT_S32: out_fmt = FMT_S32_NE; break;
         case AV_SAMPLE_FMT_FLT: out_fmt = FMT_FLOAT; break;
+        case AV_SAMPLE_FMT_U8P: out_fmt = FMT_U8; planar = TRUE; break;
+        case AV_SAMPLE_FMT_S16P: out_fmt = FMT_S16_NE; planar = TRUE; break;
+        case AV_SAMPLE_FMT_S32P: out_fmt = FMT_S32_NE; planar = TRUE; break;
+        case AV_SAMPLE_FMT_FLTP: out_fmt = FMT_FLOAT; planar = TRUE; break;
     default:
         fprintf (stderr, "ffaudio: Unsupported audio format %d\n", (int) c->sample_fmt);
         goto error_exit;
@@ -477,36 +582,43 @@ static gboolean ffaudio_play (InputPlayback * playback, const gchar * filename,
 
     playback->set_params(playback, ic->bit_rate, c->sample_rate, c->channels);
 
-    g_mutex_lock(ctrl_mutex);
+    /* one frame is reused for every decode call */
+    frame = avcodec_alloc_frame ();
 
-    stop_flag = FALSE;
-    seek_value = (start_time > 0) ? start_time : -1;
-    playback->set_pb_ready(playback);
+    g_mutex_lock(ctx.mutex);
+
+    ctx.seek_value = (start_time > 0) ? start_time : -1;
     errcount = 0;
     seekable = ffaudio_codec_is_seekable(codec);
 
-    g_mutex_unlock(ctrl_mutex);
+    g_mutex_unlock(ctx.mutex);
+
+    g_static_mutex_lock (& ctx_mutex);
+    playback->set_data (playback, & ctx);
+    g_static_mutex_unlock (& ctx_mutex);
+
+    playback->set_pb_ready(playback);
 
-    while (!stop_flag && (stop_time < 0 ||
+    while (!ctx.stop_flag && (stop_time < 0 ||
      playback->output->written_time () < stop_time))
     {
         AVPacket tmp;
         gint ret;
 
-        g_mutex_lock(ctrl_mutex);
+        g_mutex_lock(ctx.mutex);
 
-        if (seek_value >= 0 && seekable)
+        if (ctx.seek_value >= 0 && seekable)
         {
-            playback->output->flush (seek_value);
-            if (av_seek_frame (ic, -1, (gint64) seek_value * AV_TIME_BASE /
+            playback->output->flush (ctx.seek_value);
+            if (av_seek_frame (ic, -1, (gint64) ctx.seek_value * AV_TIME_BASE /
              1000, AVSEEK_FLAG_ANY) < 0)
             {
                 _ERROR("error while seeking\n");
             } else
                 errcount = 0;
         }
-        seek_value = -1;
-        g_mutex_unlock(ctrl_mutex);
+        ctx.seek_value = -1;
+        g_mutex_unlock(ctx.mutex);
 
         /* Read next frame (or more) of data */
         if ((ret = av_read_frame(ic, &pkt)) < 0)
@@ -537,23 +649,24 @@ static gboolean ffaudio_play (InputPlayback * playback, const gchar * filename,
 
         /* Decode and play packet/frame */
         memcpy(&tmp, &pkt, sizeof(tmp));
-        while (tmp.size > 0 && !stop_flag)
+        while (tmp.size > 0 && !ctx.stop_flag)
         {
             /* Check for seek request and bail out if we have one */
-            g_mutex_lock(ctrl_mutex);
-            if (seek_value != -1)
+            g_mutex_lock(ctx.mutex);
+            if (ctx.seek_value != -1)
             {
                 if (!seekable)
-                    seek_value = -1;
+                    ctx.seek_value = -1;
                 else
                 {
-                    g_mutex_unlock(ctrl_mutex);
+                    g_mutex_unlock(ctx.mutex);
                     break;
                 }
             }
-            g_mutex_unlock(ctrl_mutex);
+            g_mutex_unlock(ctx.mutex);
+
+            avcodec_get_frame_defaults (frame);
 
-            AVFrame * frame = avcodec_alloc_frame ();
             int decoded = 0;
             int len = avcodec_decode_audio4 (c, frame, & decoded, & tmp);
 
@@ -569,9 +682,22 @@ static gboolean ffaudio_play (InputPlayback * playback, const gchar * filename,
             if (! decoded)
                 continue;
 
-            playback->output->write_audio (frame->data[0], FMT_SIZEOF (out_fmt)
-             * c->channels * frame->nb_samples);
-            av_free (frame);
+            gint size = FMT_SIZEOF (out_fmt) * c->channels * frame->nb_samples;
+
+            if (planar)
+            {
+                if (size > buf_size)
+                {
+                    buf = g_realloc (buf, size);
+                    buf_size = size;
+                }
+
+                interleave (buf, frame->extended_data, c->channels,
+                 frame->nb_samples, FMT_SIZEOF (out_fmt));
+                playback->output->write_audio (buf, size);
+            }
+            else
+                playback->output->write_audio (frame->data[0], size);
         }
 
         if (pkt.data)
@@ -582,10 +708,21 @@ error_exit:
 
     AUDDBG("decode loop finished, shutting down\n");
 
-    stop_flag = TRUE;
+    g_static_mutex_lock (& ctx_mutex);
+    playback->set_data (playback, NULL);
+    g_static_mutex_unlock (& ctx_mutex);
+
+    g_mutex_free (ctx.mutex);
 
     if (pkt.data)
         av_free_packet(&pkt);
+    if (frame)
+#if CHECK_LIBAVCODEC_VERSION (54, 28, 0)
+        avcodec_free_frame (& frame);
+#else
+        av_free (frame);
+#endif
+    g_free (buf);
     if (codec_opened)
         avcodec_close(c);
     if (ic != NULL)
@@ -597,38 +734,62 @@ error_exit:
 
 static void ffaudio_stop(InputPlayback * playback)
 {
-    g_mutex_lock(ctrl_mutex);
+    g_static_mutex_lock (& ctx_mutex);
+    ffaudio_playback_t * ctx = playback->get_data (playback);
 
-    if (!stop_flag)
+    if (ctx)
     {
-        stop_flag = TRUE;
-        playback->output->abort_write();
+        g_mutex_lock (ctx->mutex);
+
+        if (!ctx->stop_flag)
+        {
+            ctx->stop_flag = TRUE;
+            playback->output->abort_write();
+        }
+
+        g_mutex_unlock (ctx->mutex);
     }
 
-    g_mutex_unlock (ctrl_mutex);
+    g_static_mutex_unlock (& ctx_mutex);
 }
 
 static void ffaudio_pause(InputPlayback * playback, gboolean pause)
 {
-    g_mutex_lock(ctrl_mutex);
+    g_static_mutex_lock (& ctx_mutex);
+    ffaudio_playback_t * ctx = playback->get_data (playback);
+
+    if (ctx)
+    {
+        g_mutex_lock (ctx->mutex);
 
-    if (!stop_flag)
-        playback->output->pause(pause);
+        if (!ctx->stop_flag)
+            playback->output->pause(pause);
 
-    g_mutex_unlock(ctrl_mutex);
+        g_mutex_unlock (ctx->mutex);
+    }
+
+    g_static_mutex_unlock (& ctx_mutex);
 }
 
 static void ffaudio_seek (InputPlayback * playback, gint time)
 {
-    g_mutex_lock(ctrl_mutex);
+    g_static_mutex_lock (& ctx_mutex);
+    ffaudio_playback_t * ctx = playback->get_data (playback);
 
-    if (!stop_flag)
+    if (ctx)
     {
-        seek_value = time;
-        playback->output->abort_write();
+        g_mutex_lock (ctx->mutex);
+
+        if (!ctx->stop_flag)
+        {
+            ctx->seek_value = time;
+            playback->output->abort_write();
+        }
+
+        g_mutex_unlock (ctx->mutex);
     }
 
-    g_mutex_unlock(ctrl_mutex);
+    g_static_mutex_unlock (& ctx_mutex);
 }
 
 static const char ffaudio_about[] =
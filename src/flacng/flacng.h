@@ -41,9 +41,8 @@ typedef struct callback_info {
     unsigned sample_rate;
     unsigned channels;
     unsigned long total_samples;
-    int32_t* output_buffer;
-    int32_t* write_pointer;
-    unsigned buffer_used;
+    void* output_buffer;                /* interleaved, SAMPLE_SIZE bytes per sample */
+    unsigned buffer_used;               /* in samples */
     VFSFile* fd;
     int bitrate;
 } callback_info;
@@ -19,6 +19,7 @@
  */
 
 #include <pthread.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <audacious/debug.h>
@@ -28,32 +29,68 @@
 #include "config.h"
 #include "flacng.h"
 
-static FLAC__StreamDecoder *decoder;
-static callback_info *info;
-static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-static int seek_value;
-static bool_t stop_flag = FALSE;
+/* Every playback owns its decoder, callback and control state, so a second
+ * stream can be opened (e.g. to preload the next song) while another one is
+ * decoding.  Finished decoders are kept in a small pool, since each of them
+ * carries a full-size output buffer. */
 
-static bool_t flac_init (void)
+#define DECODER_POOL_SIZE 2
+
+typedef struct {
+    FLAC__StreamDecoder *decoder;
+    callback_info *info;
+} FlacDecoder;
+
+static FlacDecoder *pool[DECODER_POOL_SIZE];
+static int pool_count;
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Control state of one playback, reached through playback->get_data() */
+typedef struct {
+    pthread_mutex_t mutex;
+    int seek_value;
+    bool_t stop_flag;
+} FlacPlayback;
+
+/* Only guards attaching and detaching playback contexts */
+static pthread_mutex_t ctx_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void free_decoder(FlacDecoder *dec)
+{
+    if (dec->decoder)
+        FLAC__stream_decoder_delete(dec->decoder);
+    if (dec->info)
+        clean_callback_info(dec->info);
+
+    free(dec);
+}
+
+static FlacDecoder *new_decoder(void)
 {
     FLAC__StreamDecoderInitStatus ret;
+    FlacDecoder *dec;
 
-    /* Callback structure and decoder for main decoding loop */
+    if ((dec = malloc(sizeof (FlacDecoder))) == NULL)
+        return NULL;
 
-    if ((info = init_callback_info()) == NULL)
+    dec->decoder = NULL;
+
+    if ((dec->info = init_callback_info()) == NULL)
     {
-        FLACNG_ERROR("Could not initialize the main callback structure!\n");
-        return FALSE;
+        FLACNG_ERROR("Could not initialize the callback structure!\n");
+        free_decoder(dec);
+        return NULL;
     }
 
-    if ((decoder = FLAC__stream_decoder_new()) == NULL)
+    if ((dec->decoder = FLAC__stream_decoder_new()) == NULL)
     {
-        FLACNG_ERROR("Could not create the main FLAC decoder instance!\n");
-        return FALSE;
+        FLACNG_ERROR("Could not create the FLAC decoder instance!\n");
+        free_decoder(dec);
+        return NULL;
     }
 
     if (FLAC__STREAM_DECODER_INIT_STATUS_OK != (ret = FLAC__stream_decoder_init_stream(
-        decoder,
+        dec->decoder,
         read_callback,
         seek_callback,
         tell_callback,
@@ -62,21 +99,81 @@ static bool_t flac_init (void)
         write_callback,
         metadata_callback,
         error_callback,
-        info)))
+        dec->info)))
     {
-        FLACNG_ERROR("Could not initialize the main FLAC decoder: %s(%d)\n",
+        FLACNG_ERROR("Could not initialize the FLAC decoder: %s(%d)\n",
             FLAC__StreamDecoderInitStatusString[ret], ret);
-        return FALSE;
+        free_decoder(dec);
+        return NULL;
+    }
+
+    return dec;
+}
+
+static FlacDecoder *get_decoder(void)
+{
+    FlacDecoder *dec = NULL;
+
+    pthread_mutex_lock(&pool_mutex);
+
+    if (pool_count > 0)
+        dec = pool[--pool_count];
+
+    pthread_mutex_unlock(&pool_mutex);
+
+    return dec ? dec : new_decoder();
+}
+
+static void put_decoder(FlacDecoder *dec)
+{
+    if (FLAC__stream_decoder_flush(dec->decoder) == FALSE)
+    {
+        FLACNG_ERROR("Could not flush decoder state!\n");
+        free_decoder(dec);
+        return;
+    }
+
+    reset_info(dec->info);
+    dec->info->fd = NULL;
+
+    pthread_mutex_lock(&pool_mutex);
+
+    if (pool_count < DECODER_POOL_SIZE)
+    {
+        pool[pool_count++] = dec;
+        dec = NULL;
     }
 
+    pthread_mutex_unlock(&pool_mutex);
+
+    if (dec)
+        free_decoder(dec);
+}
+
+static bool_t flac_init (void)
+{
+    /* Create the first decoder right away so that a broken libFLAC is
+     * noticed when the plugin is loaded rather than on first playback. */
+
+    FlacDecoder *dec;
+
+    if ((dec = new_decoder()) == NULL)
+        return FALSE;
+
+    put_decoder(dec);
+
     AUDDBG("Plugin initialized.\n");
     return TRUE;
 }
 
 static void flac_cleanup(void)
 {
-    FLAC__stream_decoder_delete(decoder);
-    clean_callback_info(info);
+    pthread_mutex_lock(&pool_mutex);
+
+    while (pool_count > 0)
+        free_decoder(pool[--pool_count]);
+
+    pthread_mutex_unlock(&pool_mutex);
 }
 
 bool_t flac_is_our_fd(const char *filename, VFSFile *fd)
@@ -93,46 +190,23 @@ bool_t flac_is_our_fd(const char *filename, VFSFile *fd)
     return ! strncmp (buf, "fLaC", sizeof buf);
 }
 
-static void squeeze_audio(int32_t* src, void* dst, unsigned count, unsigned res)
-{
-    int i;
-    int32_t* rp = src;
-    int8_t*  wp = dst;
-    int16_t* wp2 = dst;
-    int32_t* wp4 = dst;
-
-    switch (res)
-    {
-        case 8:
-            for (i = 0; i < count; i++, wp++, rp++)
-                *wp = *rp & 0xff;
-            break;
-
-        case 16:
-            for (i = 0; i < count; i++, wp2++, rp++)
-                *wp2 = *rp & 0xffff;
-            break;
-
-        case 24:
-        case 32:
-            for (i = 0; i < count; i++, wp4++, rp++)
-                *wp4 = *rp;
-            break;
-
-        default:
-            FLACNG_ERROR("Can not convert to %d bps\n", res);
-    }
-}
-
 static bool_t flac_play (InputPlayback * playback, const char * filename,
  VFSFile * file, int start_time, int stop_time, bool_t pause)
 {
     if (!file)
         return FALSE;
 
-    void * play_buffer = NULL;
+    FlacDecoder *dec;
+    FLAC__StreamDecoder *decoder;
+    callback_info *info;
+    FlacPlayback ctx;
     bool_t error = FALSE;
 
+    if ((dec = get_decoder()) == NULL)
+        return FALSE;
+
+    decoder = dec->decoder;
+    info = dec->info;
     info->fd = file;
 
     if (read_metadata(decoder, info) == FALSE)
@@ -142,13 +216,6 @@ static bool_t flac_play (InputPlayback * playback, const char * filename,
         goto ERR_NO_CLOSE;
     }
 
-    if ((play_buffer = malloc (BUFFER_SIZE_BYTE)) == NULL)
-    {
-        FLACNG_ERROR("Could not allocate conversion buffer\n");
-        error = TRUE;
-        goto ERR_NO_CLOSE;
-    }
-
     if (! playback->output->open_audio (SAMPLE_FMT (info->bits_per_sample),
         info->sample_rate, info->channels))
     {
@@ -159,8 +226,13 @@ static bool_t flac_play (InputPlayback * playback, const char * filename,
     if (pause)
         playback->output->pause (TRUE);
 
-    seek_value = (start_time > 0) ? start_time : -1;
-    stop_flag = FALSE;
+    pthread_mutex_init(&ctx.mutex, NULL);
+    ctx.seek_value = (start_time > 0) ? start_time : -1;
+    ctx.stop_flag = FALSE;
+
+    pthread_mutex_lock(&ctx_mutex);
+    playback->set_data(playback, &ctx);
+    pthread_mutex_unlock(&ctx_mutex);
 
     playback->set_params(playback, info->bitrate, info->sample_rate, info->channels);
     playback->set_pb_ready(playback);
@@ -174,28 +246,28 @@ static bool_t flac_play (InputPlayback * playback, const char * filename,
     while (samples_remaining && FLAC__stream_decoder_get_state(decoder) !=
      FLAC__STREAM_DECODER_END_OF_STREAM)
     {
-        pthread_mutex_lock (& mutex);
+        pthread_mutex_lock (& ctx.mutex);
 
-        if (stop_flag)
+        if (ctx.stop_flag)
         {
-            pthread_mutex_unlock (& mutex);
+            pthread_mutex_unlock (& ctx.mutex);
             break;
         }
 
-        if (seek_value >= 0)
+        if (ctx.seek_value >= 0)
         {
-            playback->output->flush (seek_value);
+            playback->output->flush (ctx.seek_value);
             FLAC__stream_decoder_seek_absolute (decoder, (int64_t)
-             seek_value * info->sample_rate / 1000);
+             ctx.seek_value * info->sample_rate / 1000);
 
             if (stop_time >= 0)
-                samples_remaining = (int64_t) (stop_time - seek_value) *
+                samples_remaining = (int64_t) (stop_time - ctx.seek_value) *
                  info->sample_rate / 1000 * info->channels;
 
-            seek_value = -1;
+            ctx.seek_value = -1;
         }
 
-        pthread_mutex_unlock (& mutex);
+        pthread_mutex_unlock (& ctx.mutex);
 
         /* Try to decode a single frame of audio */
         if (FLAC__stream_decoder_process_single(decoder) == FALSE)
@@ -208,62 +280,83 @@ static bool_t flac_play (InputPlayback * playback, const char * filename,
         if (info->buffer_used >= samples_remaining)
             info->buffer_used = samples_remaining;
 
-        squeeze_audio(info->output_buffer, play_buffer, info->buffer_used, info->bits_per_sample);
-        playback->output->write_audio(play_buffer, info->buffer_used * SAMPLE_SIZE(info->bits_per_sample));
+        playback->output->write_audio(info->output_buffer, info->buffer_used * SAMPLE_SIZE(info->bits_per_sample));
 
         samples_remaining -= info->buffer_used;
 
         reset_info(info);
     }
 
-    pthread_mutex_lock (& mutex);
-    stop_flag = TRUE;
-    pthread_mutex_unlock (& mutex);
+    pthread_mutex_lock(&ctx_mutex);
+    playback->set_data(playback, NULL);
+    pthread_mutex_unlock(&ctx_mutex);
 
-ERR_NO_CLOSE:
-    free (play_buffer);
-    reset_info(info);
+    pthread_mutex_destroy(&ctx.mutex);
 
-    if (FLAC__stream_decoder_flush(decoder) == FALSE)
-        FLACNG_ERROR("Could not flush decoder state!\n");
+ERR_NO_CLOSE:
+    put_decoder(dec);
 
     return ! error;
 }
 
 static void flac_stop(InputPlayback *playback)
 {
-    pthread_mutex_lock (& mutex);
+    pthread_mutex_lock (& ctx_mutex);
+    FlacPlayback *ctx = playback->get_data(playback);
 
-    if (!stop_flag)
+    if (ctx)
     {
-        stop_flag = TRUE;
-        playback->output->abort_write();
+        pthread_mutex_lock (& ctx->mutex);
+
+        if (!ctx->stop_flag)
+        {
+            ctx->stop_flag = TRUE;
+            playback->output->abort_write();
+        }
+
+        pthread_mutex_unlock (& ctx->mutex);
     }
 
-    pthread_mutex_unlock (& mutex);
+    pthread_mutex_unlock (& ctx_mutex);
 }
 
 static void flac_pause(InputPlayback *playback, bool_t pause)
 {
-    pthread_mutex_lock (& mutex);
+    pthread_mutex_lock (& ctx_mutex);
+    FlacPlayback *ctx = playback->get_data(playback);
+
+    if (ctx)
+    {
+        pthread_mutex_lock (& ctx->mutex);
+
+        if (!ctx->stop_flag)
+            playback->output->pause(pause);
 
-    if (!stop_flag)
-        playback->output->pause(pause);
+        pthread_mutex_unlock (& ctx->mutex);
+    }
 
-    pthread_mutex_unlock (& mutex);
+    pthread_mutex_unlock (& ctx_mutex);
 }
 
 static void flac_seek (InputPlayback * playback, int time)
 {
-    pthread_mutex_lock (& mutex);
+    pthread_mutex_lock (& ctx_mutex);
+    FlacPlayback *ctx = playback->get_data(playback);
 
-    if (!stop_flag)
+    if (ctx)
     {
-        seek_value = time;
-        playback->output->abort_write();
+        pthread_mutex_lock (& ctx->mutex);
+
+        if (!ctx->stop_flag)
+        {
+            ctx->seek_value = time;
+            playback->output->abort_write();
+        }
+
+        pthread_mutex_unlock (& ctx->mutex);
     }
 
-    pthread_mutex_unlock (& mutex);
+    pthread_mutex_unlock (& ctx_mutex);
 }
 
 static const char flac_about[] =
@@ -21,6 +21,10 @@
 #include <string.h>
 #include <FLAC/all.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <audacious/debug.h>
 
 #include "flacng.h"
@@ -112,25 +116,130 @@ FLAC__StreamDecoderLengthStatus length_callback(const FLAC__StreamDecoder *decod
     return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
 }
 
+/* The decoder hands us one array per channel, with samples that already fit
+ * the output width.  Interleave them and narrow them to that width in a
+ * single pass, straight into the buffer that goes to the output plugin. */
+
+static void interleave_8 (const FLAC__int32 * const in[], int8_t * out,
+ unsigned channels, unsigned samples)
+{
+    for (unsigned sample = 0; sample < samples; sample ++)
+    {
+        for (unsigned channel = 0; channel < channels; channel ++)
+            * out ++ = in[channel][sample];
+    }
+}
+
+static void interleave_16 (const FLAC__int32 * const in[], int16_t * out,
+ unsigned channels, unsigned samples)
+{
+    unsigned sample = 0;
+
+    if (channels == 2)
+    {
+        const FLAC__int32 * left = in[0], * right = in[1];
+
+#ifdef __SSE2__
+        /* the samples are 16-bit, so saturating never changes them */
+        for (; sample + 8 <= samples; sample += 8, out += 16)
+        {
+            __m128i l = _mm_packs_epi32 (_mm_loadu_si128 ((const __m128i *) (left + sample)),
+             _mm_loadu_si128 ((const __m128i *) (left + sample + 4)));
+            __m128i r = _mm_packs_epi32 (_mm_loadu_si128 ((const __m128i *) (right + sample)),
+             _mm_loadu_si128 ((const __m128i *) (right + sample + 4)));
+
+            _mm_storeu_si128 ((__m128i *) out, _mm_unpacklo_epi16 (l, r));
+            _mm_storeu_si128 ((__m128i *) (out + 8), _mm_unpackhi_epi16 (l, r));
+        }
+#endif
+
+        for (; sample < samples; sample ++)
+        {
+            * out ++ = left[sample];
+            * out ++ = right[sample];
+        }
+
+        return;
+    }
+
+    for (; sample < samples; sample ++)
+    {
+        for (unsigned channel = 0; channel < channels; channel ++)
+            * out ++ = in[channel][sample];
+    }
+}
+
+static void interleave_32 (const FLAC__int32 * const in[], int32_t * out,
+ unsigned channels, unsigned samples)
+{
+    unsigned sample = 0;
+
+    if (channels == 2)
+    {
+        const FLAC__int32 * left = in[0], * right = in[1];
+
+#ifdef __SSE2__
+        for (; sample + 4 <= samples; sample += 4, out += 8)
+        {
+            __m128i l = _mm_loadu_si128 ((const __m128i *) (left + sample));
+            __m128i r = _mm_loadu_si128 ((const __m128i *) (right + sample));
+
+            _mm_storeu_si128 ((__m128i *) out, _mm_unpacklo_epi32 (l, r));
+            _mm_storeu_si128 ((__m128i *) (out + 4), _mm_unpackhi_epi32 (l, r));
+        }
+#endif
+
+        for (; sample < samples; sample ++)
+        {
+            * out ++ = left[sample];
+            * out ++ = right[sample];
+        }
+
+        return;
+    }
+
+    if (channels == 1)
+    {
+        memcpy (out, in[0], sizeof (int32_t) * samples);
+        return;
+    }
+
+    for (; sample < samples; sample ++)
+    {
+        for (unsigned channel = 0; channel < channels; channel ++)
+            * out ++ = in[channel][sample];
+    }
+}
+
 FLAC__StreamDecoderWriteStatus write_callback(const FLAC__StreamDecoder *decoder, const FLAC__Frame *frame, const FLAC__int32 *const buffer[], void *client_data)
 {
     callback_info *info = (callback_info*) client_data;
+    unsigned samples = frame->header.blocksize;
+    unsigned channels = frame->header.channels;
+    int size = SAMPLE_SIZE (info->bits_per_sample);
+    char * out = (char *) info->output_buffer + (size_t) info->buffer_used * size;
 
-    if (info->channels != frame->header.channels ||
+    if (info->channels != channels ||
         info->sample_rate != frame->header.sample_rate)
     {
         return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
     }
 
-    for (long sample = 0; sample < frame->header.blocksize; sample++)
+    switch (size)
     {
-        for (short channel = 0; channel < frame->header.channels; channel++)
-        {
-            *(info->write_pointer++) = buffer[channel][sample];
-            info->buffer_used += 1;
-        }
+        case 1:
+            interleave_8 (buffer, (int8_t *) out, channels, samples);
+            break;
+        case 2:
+            interleave_16 (buffer, (int16_t *) out, channels, samples);
+            break;
+        default:
+            interleave_32 (buffer, (int32_t *) out, channels, samples);
+            break;
     }
 
+    info->buffer_used += samples * channels;
+
     return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
 }
 
@@ -58,7 +58,6 @@ void clean_callback_info(callback_info *info)
 void reset_info(callback_info *info)
 {
     info->buffer_used = 0;
-    info->write_pointer = info->output_buffer;
 }
 
 bool_t read_metadata(FLAC__StreamDecoder *decoder, callback_info *info)
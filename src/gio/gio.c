@@ -30,14 +30,41 @@
 
 #include "config.h"
 
+/* Files opened read-only are read in blocks of this size.  Once a file is
+ * being read sequentially, the following block is read ahead in the thread
+ * pool while the caller consumes the current one.  GIO allows only one
+ * pending operation per stream, so one block in flight is the most we can do.
+ * Other modes go straight to the stream. */
+#define GIO_BUF_SIZE 65536
+#define GIO_READ_THREADS 4
+
 typedef struct {
     GFile * file;
     GIOStream * iostream;
     GInputStream * istream;
     GOutputStream * ostream;
     GSeekable * seekable;
+    int64_t size;               /* cached by gio_fsize, -1 if not known */
+
+    bool_t buffered;
+    int64_t pos;                /* position seen by the caller */
+    int64_t stream_pos;         /* position of the stream, -1 if not known */
+    unsigned char * buf;
+    int64_t buf_start;          /* file position of buf[0] */
+    int64_t buf_len;            /* valid bytes in buf */
+
+    GMutex * mutex;
+    GCond * cond;
+    bool_t ahead;               /* a block has been requested */
+    bool_t ahead_pending;       /* ... and is still being read */
+    unsigned char * ahead_buf;
+    int64_t ahead_start;
+    int64_t ahead_len;
+    GError * ahead_error;
 } FileData;
 
+static GThreadPool * read_pool;
+
 #define gio_error(...) do { \
     SPRINTF (gio_error_buf, __VA_ARGS__); \
     aud_interface_show_error (gio_error_buf); \
@@ -51,6 +78,62 @@ typedef struct {
     } \
 } while (0)
 
+static void read_ahead_worker (void * job, void * unused)
+{
+    FileData * data = job;
+    GError * error = 0;
+
+    int64_t readed = g_input_stream_read (data->istream, data->ahead_buf,
+     GIO_BUF_SIZE, 0, & error);
+
+    g_mutex_lock (data->mutex);
+    data->ahead_len = error ? 0 : readed;
+    data->ahead_error = error;
+    data->ahead_pending = FALSE;
+    g_cond_signal (data->cond);
+    g_mutex_unlock (data->mutex);
+}
+
+/* requests the block following the buffer; the stream must be positioned there */
+static void gio_read_ahead (FileData * data)
+{
+    if (! data->ahead_buf)
+        data->ahead_buf = malloc (GIO_BUF_SIZE);
+
+    data->ahead = TRUE;
+    data->ahead_pending = TRUE;
+    data->ahead_start = data->stream_pos;
+
+    g_thread_pool_push (read_pool, data, NULL);
+}
+
+static void gio_wait_ahead (FileData * data)
+{
+    g_mutex_lock (data->mutex);
+    while (data->ahead_pending)
+        g_cond_wait (data->cond, data->mutex);
+    g_mutex_unlock (data->mutex);
+}
+
+/* waits for and throws away a block read ahead, so that the stream can be used */
+static void gio_cancel_ahead (FileData * data)
+{
+    if (! data->ahead)
+        return;
+
+    gio_wait_ahead (data);
+    data->ahead = FALSE;
+
+    if (data->ahead_error)
+    {
+        g_error_free (data->ahead_error);
+        data->ahead_error = 0;
+        data->stream_pos = -1;
+    }
+    else
+        data->stream_pos = data->ahead_start + data->ahead_len;
+}
+
 static void * gio_fopen (const char * filename, const char * mode)
 {
     GError * error = 0;
@@ -59,6 +142,7 @@ static void * gio_fopen (const char * filename, const char * mode)
     memset (data, 0, sizeof (FileData));
 
     data->file = g_file_new_for_uri (filename);
+    data->size = -1;
 
     switch (mode[0])
     {
@@ -76,6 +160,9 @@ static void * gio_fopen (const char * filename, const char * mode)
             data->istream = (GInputStream *) g_file_read (data->file, 0, & error);
             CHECK_ERROR ("open", filename);
             data->seekable = (GSeekable *) data->istream;
+            data->buffered = TRUE;
+            data->mutex = g_mutex_new ();
+            data->cond = g_cond_new ();
         }
         break;
     case 'w':
@@ -119,11 +206,30 @@ FAILED:
     return 0;
 }
 
+static void gio_free_data (FileData * data)
+{
+    if (data->file)
+        g_object_unref (data->file);
+
+    if (data->buffered)
+    {
+        g_mutex_free (data->mutex);
+        g_cond_free (data->cond);
+    }
+
+    free (data->buf);
+    free (data->ahead_buf);
+    free (data);
+}
+
 static int gio_fclose (VFSFile * file)
 {
     FileData * data = vfs_get_handle (file);
     GError * error = 0;
 
+    if (data->buffered)
+        gio_cancel_ahead (data);
+
     if (data->iostream)
     {
         g_io_stream_close (data->iostream, 0, & error);
@@ -143,18 +249,72 @@ static int gio_fclose (VFSFile * file)
         CHECK_ERROR ("close", vfs_get_filename (file));
     }
 
-    if (data->file)
-        g_object_unref (data->file);
-
+    gio_free_data (data);
     return 0;
 
 FAILED:
-    if (data->file)
-        g_object_unref (data->file);
-
+    gio_free_data (data);
     return -1;
 }
 
+/* refills the buffer at the caller's position; returns FALSE at the end of
+ * the file or on error */
+static bool_t gio_fill (VFSFile * file, FileData * data)
+{
+    GError * error = 0;
+    bool_t sequential = (data->buf_len > 0 && data->pos == data->buf_start + data->buf_len);
+    int64_t readed;
+
+    if (! data->buf)
+        data->buf = malloc (GIO_BUF_SIZE);
+
+    if (sequential && data->ahead && data->ahead_start == data->pos)
+    {
+        gio_wait_ahead (data);
+        data->ahead = FALSE;
+
+        unsigned char * swap = data->buf;
+        data->buf = data->ahead_buf;
+        data->ahead_buf = swap;
+
+        readed = data->ahead_len;
+        error = data->ahead_error;
+        data->ahead_error = 0;
+    }
+    else
+    {
+        gio_cancel_ahead (data);
+
+        if (data->stream_pos != data->pos)
+        {
+            g_seekable_seek (data->seekable, data->pos, G_SEEK_SET, NULL, & error);
+            CHECK_ERROR ("seek within", vfs_get_filename (file));
+            data->stream_pos = data->pos;
+        }
+
+        readed = g_input_stream_read (data->istream, data->buf, GIO_BUF_SIZE, 0, & error);
+    }
+
+    CHECK_ERROR ("read from", vfs_get_filename (file));
+
+    data->buf_start = data->pos;
+    data->buf_len = readed;
+    data->stream_pos = data->pos + readed;
+
+    if (readed <= 0)
+        return FALSE;
+
+    if (sequential)
+        gio_read_ahead (data);
+
+    return TRUE;
+
+FAILED:
+    data->buf_len = 0;
+    data->stream_pos = -1;
+    return FALSE;
+}
+
 static int64_t gio_fread (void * buf, int64_t size, int64_t nitems, VFSFile * file)
 {
     FileData * data = vfs_get_handle (file);
@@ -166,6 +326,32 @@ static int64_t gio_fread (void * buf, int64_t size, int64_t nitems, VFSFile * fi
         return 0;
     }
 
+    if (data->buffered)
+    {
+        int64_t goal = size * nitems;
+        int64_t total = 0;
+
+        while (total < goal)
+        {
+            int64_t offset = data->pos - data->buf_start;
+
+            if (offset >= 0 && offset < data->buf_len)
+            {
+                int64_t copy = data->buf_len - offset;
+                if (copy > goal - total)
+                    copy = goal - total;
+
+                memcpy ((char *) buf + total, data->buf + offset, copy);
+                data->pos += copy;
+                total += copy;
+            }
+            else if (! gio_fill (file, data))
+                break;
+        }
+
+        return (size > 0) ? total / size : 0;
+    }
+
     int64_t readed = g_input_stream_read (data->istream, buf, size * nitems, 0, & error);
     CHECK_ERROR ("read from", vfs_get_filename (file));
 
@@ -186,6 +372,8 @@ static int64_t gio_fwrite (const void * buf, int64_t size, int64_t nitems, VFSFi
         return 0;
     }
 
+    data->size = -1;
+
     int64_t written = g_output_stream_write (data->ostream, buf, size * nitems, 0, & error);
     CHECK_ERROR ("write to", vfs_get_filename (file));
 
@@ -217,9 +405,32 @@ static int gio_fseek (VFSFile * file, int64_t offset, int whence)
         return -1;
     }
 
+    if (data->buffered)
+    {
+        /* short seeks (ungetc, feof) stay within the buffer */
+        if (whence != SEEK_END)
+        {
+            int64_t pos = (whence == SEEK_SET) ? offset : data->pos + offset;
+
+            if (pos >= data->buf_start && pos <= data->buf_start + data->buf_len)
+            {
+                data->pos = pos;
+                return 0;
+            }
+
+            offset = pos;
+            gwhence = G_SEEK_SET;
+        }
+
+        gio_cancel_ahead (data);
+    }
+
     g_seekable_seek (data->seekable, offset, gwhence, NULL, & error);
     CHECK_ERROR ("seek within", vfs_get_filename (file));
 
+    if (data->buffered)
+        data->pos = data->stream_pos = g_seekable_tell (data->seekable);
+
     return 0;
 
 FAILED:
@@ -229,12 +440,29 @@ FAILED:
 static int64_t gio_ftell (VFSFile * file)
 {
     FileData * data = vfs_get_handle (file);
+
+    if (data->buffered)
+        return data->pos;
+
     return g_seekable_tell (data->seekable);
 }
 
 static int gio_getc (VFSFile * file)
 {
+    FileData * data = vfs_get_handle (file);
     unsigned char c;
+
+    if (data->buffered)
+    {
+        int64_t offset = data->pos - data->buf_start;
+
+        if (offset >= 0 && offset < data->buf_len)
+        {
+            data->pos ++;
+            return data->buf[offset];
+        }
+    }
+
     return (gio_fread (& c, 1, 1, file) == 1) ? c : -1;
 }
 
@@ -264,6 +492,8 @@ static int gio_ftruncate (VFSFile * file, int64_t length)
     FileData * data = vfs_get_handle (file);
     GError * error = 0;
 
+    data->size = -1;
+
     g_seekable_truncate (data->seekable, length, NULL, & error);
     CHECK_ERROR ("truncate", vfs_get_filename (file));
 
@@ -285,19 +515,34 @@ static int64_t gio_fsize (VFSFile * file)
     if (! g_seekable_can_seek (data->seekable))
         return -1;
 
+    if (data->size >= 0)
+        return data->size;
+
     GFileInfo * info = g_file_query_info (data->file,
      G_FILE_ATTRIBUTE_STANDARD_SIZE, 0, 0, & error);
     CHECK_ERROR ("get size of", vfs_get_filename (file));
 
-    int64_t size = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_STANDARD_SIZE);
+    data->size = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_STANDARD_SIZE);
 
     g_object_unref (info);
-    return size;
+    return data->size;
 
 FAILED:
     return -1;
 }
 
+static bool_t gio_init (void)
+{
+    read_pool = g_thread_pool_new (read_ahead_worker, NULL, GIO_READ_THREADS, FALSE, NULL);
+    return TRUE;
+}
+
+static void gio_cleanup (void)
+{
+    g_thread_pool_free (read_pool, FALSE, TRUE);
+    read_pool = NULL;
+}
+
 static const char gio_about[] =
  N_("GIO Plugin for Audacious\n"
     "Copyright 2009-2012 John Lindgren");
@@ -324,6 +569,8 @@ AUD_TRANSPORT_PLUGIN
     .name = N_("GIO Plugin"),
     .domain = PACKAGE,
     .about_text = gio_about,
+    .init = gio_init,
+    .cleanup = gio_cleanup,
     .schemes = gio_schemes,
     .vtable = & constructor
 )
@@ -42,6 +42,8 @@
 #include "ui_statusbar.h"
 #include "playlist_util.h"
 
+#include "../ui-common/update_timer.h"
+
 static const gchar * const gtkui_defaults[] = {
  "infoarea_show_vis", "TRUE",
  "infoarea_visible", "TRUE",
@@ -69,7 +71,6 @@ static PluginHandle * search_tool;
 
 static GtkWidget *volume;
 static gboolean volume_slider_is_moving = FALSE;
-static guint update_volume_timeout_source = 0;
 static gulong volume_change_handler_id;
 
 static GtkAccelGroup * accel;
@@ -85,7 +86,7 @@ static GtkWidget * error_win = NULL;
 
 static gboolean slider_is_moving = FALSE;
 static guint delayed_title_change_source = 0;
-static guint update_song_timeout_source = 0;
+static UpdateTimer update_timer;
 
 static gboolean init (void);
 static void cleanup (void);
@@ -270,10 +271,10 @@ static void set_slider (gint time)
     gtk_range_set_value ((GtkRange *) slider, time);
 }
 
-static gboolean time_counter_cb (void)
+static void time_counter_cb (void)
 {
     if (slider_is_moving)
-        return TRUE;
+        return;
 
     gint time = aud_drct_get_time ();
     gint length = aud_drct_get_length ();
@@ -282,8 +283,6 @@ static gboolean time_counter_cb (void)
         set_slider (time);
 
     set_time_label (time, length);
-
-    return TRUE;
 }
 
 static void do_seek (gint time)
@@ -291,15 +290,6 @@ static void do_seek (gint time)
     set_slider (time);
     set_time_label (time, aud_drct_get_length ());
     aud_drct_seek (time);
-
-    // Trick: Unschedule and then schedule the update function.  This gives the
-    // player 1/4 second to perform the seek before we update the display again,
-    // in an attempt to reduce flickering.
-    if (update_song_timeout_source)
-    {
-        g_source_remove (update_song_timeout_source);
-        update_song_timeout_source = g_timeout_add (250, (GSourceFunc) time_counter_cb, NULL);
-    }
 }
 
 static gboolean ui_slider_change_value_cb(GtkRange * range, GtkScrollType scroll)
@@ -342,23 +332,21 @@ static void ui_volume_released_cb(GtkButton *button, gpointer user_data)
     volume_slider_is_moving = FALSE;
 }
 
-static gboolean ui_volume_slider_update(gpointer data)
+static void ui_volume_slider_update (void)
 {
-    gint volume;
+    gint vol;
 
-    if (volume_slider_is_moving || data == NULL)
-        return TRUE;
+    if (volume_slider_is_moving || volume == NULL)
+        return;
 
-    aud_drct_get_volume_main(&volume);
+    aud_drct_get_volume_main(&vol);
 
-    if (volume == (gint) gtk_scale_button_get_value(GTK_SCALE_BUTTON(data)))
-        return TRUE;
-
-    g_signal_handler_block(data, volume_change_handler_id);
-    gtk_scale_button_set_value(GTK_SCALE_BUTTON(data), volume);
-    g_signal_handler_unblock(data, volume_change_handler_id);
+    if (vol == (gint) gtk_scale_button_get_value(GTK_SCALE_BUTTON(volume)))
+        return;
 
-    return TRUE;
+    g_signal_handler_block(volume, volume_change_handler_id);
+    gtk_scale_button_set_value(GTK_SCALE_BUTTON(volume), vol);
+    g_signal_handler_unblock(volume, volume_change_handler_id);
 }
 
 static void set_slider_length (gint length)
@@ -398,22 +386,11 @@ static void ui_playback_ready (void)
     set_slider_length (aud_drct_get_length ());
     time_counter_cb ();
 
-    /* update time counter 4 times a second */
-    if (! update_song_timeout_source)
-        update_song_timeout_source = g_timeout_add (250, (GSourceFunc)
-         time_counter_cb, NULL);
-
     gtk_widget_show (label_time);
 }
 
 static void ui_playback_stop (void)
 {
-    if (update_song_timeout_source)
-    {
-        g_source_remove(update_song_timeout_source);
-        update_song_timeout_source = 0;
-    }
-
     if (delayed_title_change_source)
         g_source_remove (delayed_title_change_source);
 
@@ -466,6 +443,14 @@ static void window_mapped_cb (GtkWidget * widget, void * unused)
     gtk_widget_grab_focus (playlist_get_treeview (aud_playlist_get_active ()));
 }
 
+/* stop updating the time display while the window is hidden or minimized */
+static gboolean window_state_cb (GtkWidget * widget, GdkEventWindowState * event)
+{
+    update_timer_set_hidden (& update_timer, (event->new_window_state &
+     (GDK_WINDOW_STATE_WITHDRAWN | GDK_WINDOW_STATE_ICONIFIED)) ? TRUE : FALSE);
+    return FALSE;
+}
+
 static gboolean window_keypress_cb (GtkWidget * widget, GdkEventKey * event, void * unused)
 {
     switch (event->state & (GDK_SHIFT_MASK | GDK_CONTROL_MASK | GDK_MOD1_MASK))
@@ -803,6 +788,7 @@ static gboolean init (void)
 
     AUDDBG("hooks associate\n");
     ui_hooks_associate();
+    update_timer_start (& update_timer, "gtkui", time_counter_cb);
 
     AUDDBG("playlist associate\n");
     ui_playlist_notebook_populate();
@@ -814,9 +800,10 @@ static gboolean init (void)
     volume_change_handler_id = g_signal_connect(volume, "value-changed", G_CALLBACK(ui_volume_value_changed_cb), NULL);
     g_signal_connect(volume, "pressed", G_CALLBACK(ui_volume_pressed_cb), NULL);
     g_signal_connect(volume, "released", G_CALLBACK(ui_volume_released_cb), NULL);
-    update_volume_timeout_source = g_timeout_add(250, (GSourceFunc) ui_volume_slider_update, volume);
+    update_timer_set_poll (& update_timer, ui_volume_slider_update);
 
     g_signal_connect (window, "map-event", (GCallback) window_mapped_cb, NULL);
+    g_signal_connect (window, "window-state-event", (GCallback) window_state_cb, NULL);
     g_signal_connect (window, "key-press-event", (GCallback) window_keypress_cb, NULL);
     g_signal_connect (UI_PLAYLIST_NOTEBOOK, "key-press-event", (GCallback) playlist_keypress_cb, NULL);
 
@@ -855,17 +842,7 @@ static void cleanup (void)
     gtk_widget_destroy (menu_rclick);
     gtk_widget_destroy (menu_tab);
 
-    if (update_song_timeout_source)
-    {
-        g_source_remove(update_song_timeout_source);
-        update_song_timeout_source = 0;
-    }
-
-    if (update_volume_timeout_source)
-    {
-        g_source_remove(update_volume_timeout_source);
-        update_volume_timeout_source = 0;
-    }
+    update_timer_stop (& update_timer);
 
     if (delayed_title_change_source)
     {
@@ -30,6 +30,8 @@
 
 #include "ui_infoarea.h"
 
+#include "../vis-common/spectrum.h"
+
 #define SPACING 8
 #define ICON_SIZE 64
 #define HEIGHT (ICON_SIZE + 2 * SPACING)
@@ -55,8 +57,9 @@ typedef struct {
 
 static struct {
     GtkWidget * widget;
-    gchar bars[VIS_BANDS];
-    gchar delay[VIS_BANDS];
+    SpectrumMap map;
+    gint bars[VIS_BANDS];
+    gint delay[VIS_BANDS];
 } vis;
 
 /****************************************************************************/
@@ -65,41 +68,18 @@ static UIInfoArea * area = NULL;
 
 static void vis_render_cb (const gfloat * freq)
 {
-    const gfloat xscale[VIS_BANDS + 1] = {0.00, 0.59, 1.52, 3.00, 5.36, 9.10,
-     15.0, 24.5, 39.4, 63.2, 101, 161, 256}; /* logarithmic scale - 1 */
+    gfloat level[VIS_BANDS];
+
+    spectrum_map_set (& vis.map, VIS_BANDS, 1);
+    spectrum_map_apply (& vis.map, freq, level);
 
     for (gint i = 0; i < VIS_BANDS; i ++)
     {
-        gint a = ceil (xscale[i]);
-        gint b = floor (xscale[i + 1]);
-        gfloat n = 0;
-
-        if (b < a)
-            n += freq[b] * (xscale[i + 1] - xscale[i]);
-        else
-        {
-            if (a > 0)
-                n += freq[a - 1] * (a - xscale[i]);
-            for (; a < b; a ++)
-                n += freq[a];
-            if (b < 256)
-                n += freq[b] * (xscale[i + 1] - b);
-        }
-
         /* 40 dB range */
-        gint x = 20 * log10 (n * 100);
+        gint x = 20 * log10 (level[i] * 100);
         x = CLAMP (x, 0, 40);
 
-        vis.bars[i] -= MAX (0, VIS_FALLOFF - vis.delay[i]);
-
-        if (vis.delay[i])
-            vis.delay[i] --;
-
-        if (x > vis.bars[i])
-        {
-            vis.bars[i] = x;
-            vis.delay[i] = VIS_DELAY;
-        }
+        spectrum_peak (x, & vis.bars[i], & vis.delay[i], VIS_DELAY, VIS_FALLOFF);
     }
 
     if (vis.widget)
@@ -495,6 +475,7 @@ void ui_infoarea_show_vis (gboolean show)
 
         gtk_widget_destroy (vis.widget);
 
+        spectrum_map_free (& vis.map);
         memset (& vis, 0, sizeof vis);
     }
 }
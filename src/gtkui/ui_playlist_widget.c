@@ -43,28 +43,33 @@ static const gboolean pw_col_widths[PW_COLS] = {7, -1, -1, 4, -1, 2, -1, 3, 7,
 static const gboolean pw_col_label[PW_COLS] = {FALSE, TRUE, TRUE, TRUE, TRUE,
  FALSE, TRUE, FALSE, FALSE, TRUE, TRUE, TRUE, FALSE};
 
+/* Formatted column text is cached per row so that GTK redraws do not have to
+ * look up the entry's tuple again for every cell.  Only rows that have actually
+ * been drawn are cached; the cache is dropped completely once it grows past
+ * CACHE_MAX_ROWS, which is much more than ever fits on screen. */
+#define CACHE_MAX_ROWS 4096
+
 typedef struct {
     gint list;
     GList * queue;
     gint popup_source, popup_pos;
     gboolean popup_shown;
+    GArray * cache; /* gchar * * per row (PW_COLS strings), NULL if not cached */
+    gint cached_rows;
 } PlaylistWidgetData;
 
-static void set_int_from_tuple (GValue * value, const Tuple * tuple, gint field)
+static gchar * int_from_tuple (const Tuple * tuple, gint field)
 {
     gint i = tuple ? tuple_get_int (tuple, field, NULL) : 0;
-    if (i > 0)
-        g_value_take_string (value, g_strdup_printf ("%d", i));
-    else
-        g_value_set_string (value, "");
+    return (i > 0) ? g_strdup_printf ("%d", i) : g_strdup ("");
 }
 
-static void set_string_from_tuple (GValue * value, const Tuple * tuple,
- gint field)
+static gchar * string_from_tuple (const Tuple * tuple, gint field)
 {
-    gchar *str = tuple ? tuple_get_str (tuple, field, NULL) : NULL;
-    g_value_set_string (value, str);
-    str_unref(str);
+    gchar * str = tuple ? tuple_get_str (tuple, field, NULL) : NULL;
+    gchar * copy = g_strdup (str ? str : "");
+    str_unref (str);
+    return copy;
 }
 
 static void set_queued (GValue * value, gint list, gint row)
@@ -97,6 +102,160 @@ static void set_length (GValue * value, gint list, gint row)
         g_value_set_string (value, "");
 }
 
+static gchar * * cache_row_new (gint list, gint row)
+{
+    gboolean need_describe = FALSE, need_tuple = FALSE;
+
+    for (gint i = 0; i < pw_num_cols; i ++)
+    {
+        switch (pw_cols[i])
+        {
+        case PW_COL_TITLE:
+        case PW_COL_ARTIST:
+        case PW_COL_ALBUM:
+            need_describe = TRUE;
+            break;
+        case PW_COL_YEAR:
+        case PW_COL_TRACK:
+        case PW_COL_GENRE:
+        case PW_COL_FILENAME:
+        case PW_COL_PATH:
+        case PW_COL_BITRATE:
+            need_tuple = TRUE;
+            break;
+        }
+    }
+
+    gchar * title = NULL, * artist = NULL, * album = NULL;
+    Tuple * tuple = NULL;
+
+    if (need_describe)
+        aud_playlist_entry_describe (list, row, & title, & artist, & album,
+         TRUE);
+    if (need_tuple)
+        tuple = aud_playlist_entry_get_tuple (list, row, TRUE);
+
+    gchar * * cells = g_new0 (gchar *, PW_COLS);
+
+    for (gint i = 0; i < pw_num_cols; i ++)
+    {
+        gint column = pw_cols[i];
+        if (cells[column])
+            continue;
+
+        switch (column)
+        {
+        case PW_COL_TITLE:
+            cells[column] = g_strdup (title ? title : "");
+            break;
+        case PW_COL_ARTIST:
+            cells[column] = g_strdup (artist ? artist : "");
+            break;
+        case PW_COL_YEAR:
+            cells[column] = int_from_tuple (tuple, FIELD_YEAR);
+            break;
+        case PW_COL_ALBUM:
+            cells[column] = g_strdup (album ? album : "");
+            break;
+        case PW_COL_TRACK:
+            cells[column] = int_from_tuple (tuple, FIELD_TRACK_NUMBER);
+            break;
+        case PW_COL_GENRE:
+            cells[column] = string_from_tuple (tuple, FIELD_GENRE);
+            break;
+        case PW_COL_FILENAME:
+            cells[column] = string_from_tuple (tuple, FIELD_FILE_NAME);
+            break;
+        case PW_COL_PATH:
+            cells[column] = string_from_tuple (tuple, FIELD_FILE_PATH);
+            break;
+        case PW_COL_CUSTOM:;
+            gchar * custom = aud_playlist_entry_get_title (list, row, TRUE);
+            cells[column] = g_strdup (custom ? custom : "");
+            str_unref (custom);
+            break;
+        case PW_COL_BITRATE:
+            cells[column] = int_from_tuple (tuple, FIELD_BITRATE);
+            break;
+        }
+    }
+
+    str_unref (title);
+    str_unref (artist);
+    str_unref (album);
+    if (tuple)
+        tuple_unref (tuple);
+
+    return cells;
+}
+
+static void cache_row_free (gchar * * cells)
+{
+    if (! cells)
+        return;
+
+    for (gint i = 0; i < PW_COLS; i ++)
+        g_free (cells[i]);
+
+    g_free (cells);
+}
+
+static void cache_invalidate (PlaylistWidgetData * data, gint at, gint count)
+{
+    gint rows = data->cache->len;
+    at = CLAMP (at, 0, rows);
+    count = CLAMP (count, 0, rows - at);
+
+    gchar * * * cache = (gchar * * *) data->cache->data;
+
+    for (gint row = at; row < at + count && data->cached_rows; row ++)
+    {
+        if (cache[row])
+        {
+            cache_row_free (cache[row]);
+            cache[row] = NULL;
+            data->cached_rows --;
+        }
+    }
+}
+
+static void cache_insert (PlaylistWidgetData * data, gint at, gint count)
+{
+    at = CLAMP (at, 0, (gint) data->cache->len);
+    gchar * * * empty = g_new0 (gchar * *, count);
+    g_array_insert_vals (data->cache, at, empty, count);
+    g_free (empty);
+}
+
+static void cache_delete (PlaylistWidgetData * data, gint at, gint count)
+{
+    gint rows = data->cache->len;
+    at = CLAMP (at, 0, rows);
+    count = CLAMP (count, 0, rows - at);
+
+    cache_invalidate (data, at, count);
+    g_array_remove_range (data->cache, at, count);
+}
+
+static gchar * * cache_lookup (PlaylistWidgetData * data, gint row)
+{
+    if (row >= (gint) data->cache->len)
+        cache_insert (data, data->cache->len, row + 1 - data->cache->len);
+
+    gchar * * * cache = (gchar * * *) data->cache->data;
+
+    if (! cache[row])
+    {
+        if (data->cached_rows >= CACHE_MAX_ROWS)
+            cache_invalidate (data, 0, data->cache->len);
+
+        cache[row] = cache_row_new (data->list, row);
+        data->cached_rows ++;
+    }
+
+    return cache[row];
+}
+
 static void get_value (void * user, gint row, gint column, GValue * value)
 {
     PlaylistWidgetData * data = user;
@@ -105,68 +264,21 @@ static void get_value (void * user, gint row, gint column, GValue * value)
 
     column = pw_cols[column];
 
-    gchar * title = NULL, * artist = NULL, * album = NULL;
-    Tuple * tuple = NULL;
-
-    if (column == PW_COL_TITLE || column == PW_COL_ARTIST || column ==
-     PW_COL_ALBUM)
-        aud_playlist_entry_describe (data->list, row, & title, & artist,
-         & album, TRUE);
-    else if (column == PW_COL_YEAR || column == PW_COL_TRACK || column ==
-     PW_COL_GENRE || column == PW_COL_FILENAME || column == PW_COL_PATH ||
-     column == PW_COL_BITRATE)
-        tuple = aud_playlist_entry_get_tuple (data->list, row, TRUE);
-
     switch (column)
     {
     case PW_COL_NUMBER:
         g_value_set_int (value, 1 + row);
         break;
-    case PW_COL_TITLE:
-        g_value_set_string (value, title);
-        break;
-    case PW_COL_ARTIST:
-        g_value_set_string (value, artist);
-        break;
-    case PW_COL_YEAR:
-        set_int_from_tuple (value, tuple, FIELD_YEAR);
-        break;
-    case PW_COL_ALBUM:
-        g_value_set_string (value, album);
-        break;
-    case PW_COL_TRACK:
-        set_int_from_tuple (value, tuple, FIELD_TRACK_NUMBER);
-        break;
-    case PW_COL_GENRE:
-        set_string_from_tuple (value, tuple, FIELD_GENRE);
-        break;
     case PW_COL_QUEUED:
         set_queued (value, data->list, row);
         break;
     case PW_COL_LENGTH:
         set_length (value, data->list, row);
         break;
-    case PW_COL_FILENAME:
-        set_string_from_tuple (value, tuple, FIELD_FILE_NAME);
-        break;
-    case PW_COL_PATH:
-        set_string_from_tuple (value, tuple, FIELD_FILE_PATH);
-        break;
-    case PW_COL_CUSTOM:;
-        gchar * custom = aud_playlist_entry_get_title (data->list, row, TRUE);
-        g_value_set_string (value, custom);
-        str_unref (custom);
-        break;
-    case PW_COL_BITRATE:
-        set_int_from_tuple (value, tuple, FIELD_BITRATE);
+    default:
+        g_value_set_string (value, cache_lookup (data, row)[column]);
         break;
     }
-
-    str_unref (title);
-    str_unref (artist);
-    str_unref (album);
-    if (tuple)
-        tuple_unref (tuple);
 }
 
 static gboolean get_selected (void * user, gint row)
@@ -356,9 +468,47 @@ static gboolean search_cb (GtkTreeModel * model, gint column, const gchar * key,
 static void destroy_cb (PlaylistWidgetData * data)
 {
     g_list_free (data->queue);
+    cache_invalidate (data, 0, data->cache->len);
+    g_array_free (data->cache, TRUE);
     g_free (data);
 }
 
+/* With fixed sizing on every column, GTK can use fixed-height mode and skips
+ * measuring each row of the (possibly huge) playlist.  Columns with a width in
+ * characters get that width; the others start empty and are expanded. */
+static void set_fixed_sizing (GtkWidget * list)
+{
+    PangoLayout * layout = gtk_widget_create_pango_layout (list, "0");
+    gint digit;
+    pango_layout_get_pixel_size (layout, & digit, NULL);
+    g_object_unref (layout);
+
+    GList * columns = gtk_tree_view_get_columns ((GtkTreeView *) list);
+    gint first = g_list_length (columns) - pw_num_cols;
+    gint i = 0;
+
+    for (GList * node = columns; node; node = node->next, i ++)
+    {
+        GtkTreeViewColumn * column = node->data;
+        gtk_tree_view_column_set_sizing (column, GTK_TREE_VIEW_COLUMN_FIXED);
+
+        if (i < first || pw_col_widths[pw_cols[i - first]] < 1)
+            continue;
+
+        gint xpad = 0;
+        GList * cells = gtk_cell_layout_get_cells ((GtkCellLayout *) column);
+        if (cells)
+            gtk_cell_renderer_get_padding (cells->data, & xpad, NULL);
+        g_list_free (cells);
+
+        gtk_tree_view_column_set_fixed_width (column, digit *
+         pw_col_widths[pw_cols[i - first]] + 2 * xpad);
+    }
+
+    g_list_free (columns);
+    gtk_tree_view_set_fixed_height_mode ((GtkTreeView *) list, TRUE);
+}
+
 GtkWidget * ui_playlist_widget_new (gint playlist)
 {
     PlaylistWidgetData * data = g_malloc0 (sizeof (PlaylistWidgetData));
@@ -367,6 +517,9 @@ GtkWidget * ui_playlist_widget_new (gint playlist)
     data->popup_source = 0;
     data->popup_pos = -1;
     data->popup_shown = FALSE;
+    data->cache = g_array_new (FALSE, TRUE, sizeof (gchar * *));
+    data->cached_rows = 0;
+    cache_insert (data, 0, aud_playlist_entry_count (playlist));
 
     GtkWidget * list = audgui_list_new (& callbacks, data,
      aud_playlist_entry_count (playlist));
@@ -389,6 +542,8 @@ GtkWidget * ui_playlist_widget_new (gint playlist)
          NULL, i, pw_col_types[n], pw_col_widths[n]);
     }
 
+    set_fixed_sizing (list);
+
     return list;
 }
 
@@ -434,9 +589,15 @@ void ui_playlist_widget_update (GtkWidget * widget, gint type, gint at,
          audgui_list_row_count (widget);
 
         if (diff > 0)
+        {
+            cache_insert (data, at, diff);
             audgui_list_insert_rows (widget, at, diff);
+        }
         else if (diff < 0)
+        {
+            cache_delete (data, at, -diff);
             audgui_list_delete_rows (widget, at, -diff);
+        }
 
         audgui_list_set_highlight (widget, aud_playlist_get_position (data->list));
 
@@ -444,7 +605,10 @@ void ui_playlist_widget_update (GtkWidget * widget, gint type, gint at,
     }
 
     if (type >= PLAYLIST_UPDATE_METADATA)
+    {
+        cache_invalidate (data, at, count);
         audgui_list_update_rows (widget, at, count);
+    }
 
     audgui_list_update_selection (widget, at, count);
     update_queue (widget, data);
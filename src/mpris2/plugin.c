@@ -32,13 +32,16 @@
 #include "object-core.h"
 #include "object-player.h"
 
+#include "../ui-common/update_timer.h"
+
 static GDBusConnection * bus;
 static GObject * object_core, * object_player;
 static char * last_title, * last_artist, * last_album, * last_file;
 static int last_length;
 static const char * image_file;
 static GVariantType * metadata_type;
-static int update_timer;
+static UpdateTimer update_timer;
+static int last_volume = -1;
 
 static bool_t quit_cb (MprisMediaPlayer2 * object, GDBusMethodInvocation * call,
  void * unused)
@@ -170,20 +173,30 @@ static void volume_changed (GObject * object)
     aud_drct_set_volume_main (round (vol * 100));
 }
 
-static bool_t update (GObject * object)
+static void update_timer_cb (void)
 {
     int64_t pos = 0;
-    int vol = 0;
 
     if (aud_drct_get_playing () && aud_drct_get_ready ())
         pos = (int64_t) aud_drct_get_time () * 1000;
 
+    g_object_set (object_player, "position", pos, NULL);
+}
+
+/* There is no hook for volume changes, so the volume is polled. */
+static void volume_poll (void)
+{
+    int vol = 0;
+
     aud_drct_get_volume_main (& vol);
 
-    g_signal_handlers_block_by_func (object, (void *) volume_changed, NULL);
-    g_object_set (object, "position", pos, "volume", (double) vol / 100, NULL);
-    g_signal_handlers_unblock_by_func (object, (void *) volume_changed, NULL);
-    return TRUE;
+    if (vol != last_volume)
+    {
+        g_signal_handlers_block_by_func (object_player, (void *) volume_changed, NULL);
+        g_object_set (object_player, "volume", (double) vol / 100, NULL);
+        g_signal_handlers_unblock_by_func (object_player, (void *) volume_changed, NULL);
+        last_volume = vol;
+    }
 }
 
 static void update_playback_status (void * data, GObject * object)
@@ -296,11 +309,7 @@ void mpris2_cleanup (void)
     hook_dissociate ("playback ready", (HookFunction) emit_seek);
     hook_dissociate ("playback seek", (HookFunction) emit_seek);
 
-    if (update_timer)
-    {
-        g_source_remove (update_timer);
-        update_timer = 0;
-    }
+    update_timer_stop (& update_timer);
 
     g_dbus_connection_close_sync (bus, NULL, NULL);
     g_object_unref (object_core);
@@ -364,7 +373,11 @@ bool_t mpris2_init (void)
      "can-seek", TRUE,
      NULL);
 
-    update_timer = g_timeout_add (250, (GSourceFunc) update, object_player);
+    update_timer_start (& update_timer, "mpris2", update_timer_cb);
+
+    last_volume = -1;
+    volume_poll ();
+    update_timer_set_poll (& update_timer, volume_poll);
     update_playback_status (NULL, object_player);
 
     if (aud_drct_get_playing () && aud_drct_get_ready ())
@@ -0,0 +1,236 @@
+/*
+ *  A neon HTTP input plugin for Audacious
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include "cache.h"
+#include "debug.h"
+
+#define NEON_CACHE_URLS     4
+#define NEON_CACHE_SIZE     (1024u*1024u)
+
+struct cache_segment {
+    gulong start;
+    GByteArray* data;
+};
+
+struct cache_entry {
+    gchar* url;
+    glong length;
+    GList* segments;
+    gulong size;
+};
+
+static GStaticMutex cache_mutex = G_STATIC_MUTEX_INIT;
+static GQueue cache_entries = G_QUEUE_INIT;     /* Most recently used first */
+
+/*
+ * -----
+ */
+
+static void clear_entry(struct cache_entry* e) {
+
+    GList* node;
+
+    for (node = e->segments; node != NULL; node = node->next) {
+        struct cache_segment* s = node->data;
+        g_byte_array_free(s->data, TRUE);
+        g_free(s);
+    }
+
+    g_list_free(e->segments);
+    e->segments = NULL;
+    e->size = 0;
+}
+
+static void free_entry(struct cache_entry* e) {
+
+    _DEBUG("Dropping cache for %s", e->url);
+
+    clear_entry(e);
+    g_free(e->url);
+    g_free(e);
+}
+
+/*
+ * Look up the entry for a URL, and move it to the front.
+ * Must be called with the cache locked.
+ */
+static struct cache_entry* find_entry(const gchar* url, glong length, gboolean create) {
+
+    GList* node;
+    struct cache_entry* e;
+
+    for (node = cache_entries.head; node != NULL; node = node->next) {
+        e = node->data;
+
+        if (strcmp(e->url, url)) {
+            continue;
+        }
+
+        if (e->length != length) {
+            _DEBUG("Length of %s changed, dropping cached data", url);
+            clear_entry(e);
+            e->length = length;
+        }
+
+        g_queue_unlink(&cache_entries, node);
+        g_queue_push_head_link(&cache_entries, node);
+        return e;
+    }
+
+    if (!create) {
+        return NULL;
+    }
+
+    e = g_new0(struct cache_entry, 1);
+    e->url = g_strdup(url);
+    e->length = length;
+    g_queue_push_head(&cache_entries, e);
+
+    while (cache_entries.length > NEON_CACHE_URLS) {
+        free_entry(g_queue_pop_tail(&cache_entries));
+    }
+
+    return e;
+}
+
+static struct cache_segment* find_segment(struct cache_entry* e, gulong pos) {
+
+    GList* node;
+
+    for (node = e->segments; node != NULL; node = node->next) {
+        struct cache_segment* s = node->data;
+
+        if ((pos >= s->start) && (pos < s->start + s->data->len)) {
+            return s;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * -----
+ */
+
+/*
+ * Remember size bytes of the URL starting at pos.
+ * Return FALSE if the cache for the URL is full.
+ */
+gboolean neon_cache_store(const gchar* url, glong length, gulong pos, const void* data, gulong size) {
+
+    struct cache_entry* e;
+    struct cache_segment* s = NULL;
+    GList* node;
+    gboolean ret = TRUE;
+
+    g_static_mutex_lock(&cache_mutex);
+
+    e = find_entry(url, length, TRUE);
+
+    if (NULL != find_segment(e, pos)) {
+        /* Already known */
+        goto out;
+    }
+
+    if (e->size + size > NEON_CACHE_SIZE) {
+        size = NEON_CACHE_SIZE - e->size;
+        ret = FALSE;
+    }
+
+    if (0 == size) {
+        goto out;
+    }
+
+    for (node = e->segments; node != NULL; node = node->next) {
+        struct cache_segment* t = node->data;
+
+        if (t->start + t->data->len == pos) {
+            s = t;
+            break;
+        }
+    }
+
+    if (NULL == s) {
+        s = g_new(struct cache_segment, 1);
+        s->start = pos;
+        s->data = g_byte_array_new();
+        e->segments = g_list_prepend(e->segments, s);
+    }
+
+    g_byte_array_append(s->data, data, size);
+    e->size += size;
+
+out:
+    g_static_mutex_unlock(&cache_mutex);
+    return ret;
+}
+
+/*
+ * Return TRUE if the byte at pos is cached
+ */
+gboolean neon_cache_contains(const gchar* url, glong length, gulong pos) {
+
+    struct cache_entry* e;
+    gboolean ret;
+
+    g_static_mutex_lock(&cache_mutex);
+    ret = (NULL != (e = find_entry(url, length, FALSE))) && (NULL != find_segment(e, pos));
+    g_static_mutex_unlock(&cache_mutex);
+
+    return ret;
+}
+
+/*
+ * Copy up to size bytes of the URL starting at pos into data.
+ * Return the number of bytes copied, 0 if pos is not cached.
+ */
+gulong neon_cache_fetch(const gchar* url, glong length, gulong pos, void* data, gulong size) {
+
+    struct cache_entry* e;
+    struct cache_segment* s;
+    gulong ret = 0;
+
+    g_static_mutex_lock(&cache_mutex);
+
+    if ((NULL != (e = find_entry(url, length, FALSE))) && (NULL != (s = find_segment(e, pos)))) {
+        ret = MIN(size, s->start + s->data->len - pos);
+        memcpy(data, s->data->data + (pos - s->start), ret);
+    }
+
+    g_static_mutex_unlock(&cache_mutex);
+    return ret;
+}
+
+/*
+ * -----
+ */
+
+void neon_cache_cleanup(void) {
+
+    struct cache_entry* e;
+
+    g_static_mutex_lock(&cache_mutex);
+
+    while (NULL != (e = g_queue_pop_head(&cache_entries))) {
+        free_entry(e);
+    }
+
+    g_static_mutex_unlock(&cache_mutex);
+}
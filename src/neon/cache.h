@@ -0,0 +1,35 @@
+/*
+ *  A neon HTTP input plugin for Audacious
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _NEON_CACHE_H
+#define _NEON_CACHE_H
+
+#include <glib.h>
+
+/*
+ * Byte ranges recently fetched from seekable URLs, shared by all
+ * handles. A URL is identified by its address and its total length;
+ * if the length changes, everything cached for it is dropped.
+ */
+
+void neon_cache_cleanup(void);
+gboolean neon_cache_store(const gchar* url, glong length, gulong pos, const void* data, gulong size);
+gboolean neon_cache_contains(const gchar* url, glong length, gulong pos);
+gulong neon_cache_fetch(const gchar* url, glong length, gulong pos, void* data, gulong size);
+
+#endif
@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
 
 #ifdef DEBUG
 #define NEON_DEBUG
@@ -40,13 +41,65 @@
 #include "config.h"
 #include "debug.h"
 #include "rb.h"
+#include "cache.h"
 #include "cert_verification.h"
 
+/*
+ * The buffer is sized when the reader thread starts, to hold
+ * NEON_BUFSECS seconds of the stream plus one round trip to the server,
+ * within [NEON_BUFSIZE, NEON_MAX_BUFSIZE]. The reader thread goes to
+ * sleep when less than NEON_NETBLKSIZE is free, and is woken up only once
+ * half of the buffer is free again.
+ */
 #define NEON_BUFSIZE        (128u*1024u)
-#define NEON_NETBLKSIZE     (4096u)
+#define NEON_MAX_BUFSIZE    (4u*1024u*1024u)
+#define NEON_BUFSECS        4
+#define NEON_DEFAULT_RATE   (320000/8)
+#define NEON_NETBLKSIZE     (16384u)
+#define NEON_WAKEMARK(h)    ((h)->rb.size / 2)
 #define NEON_ICY_BUFSIZE    (4096)
 #define NEON_RETRY_COUNT 6
 
+/*
+ * When the server accepts range requests, the first seek into the last
+ * NEON_TAIL_SIZE bytes of the file fetches all of them into the cache
+ * over a second connection, so that decoders looking for tags or indexes
+ * at the end neither reconnect for each of them nor lose their place at
+ * the start.
+ */
+#define NEON_TAIL_SIZE      (128u*1024u)
+
+/*
+ * Sessions are kept open after use, so that the next request to the
+ * same server (and through the same proxy) can reuse the connection,
+ * or at least resume the TLS session. At most NEON_POOL_PER_HOST idle
+ * sessions are kept per server, NEON_POOL_SIZE in total, each for up to
+ * NEON_POOL_IDLE_TIME seconds. A request closed less than
+ * NEON_DRAIN_SIZE bytes before its end is read to the end, which is
+ * cheaper than a new connection. Optional connections, such as the one
+ * fetching the end of a file, are not opened while NEON_ACTIVE_PER_HOST
+ * connections to the server are in use.
+ */
+#define NEON_POOL_SIZE      8
+#define NEON_POOL_PER_HOST  2
+#define NEON_ACTIVE_PER_HOST 4
+#define NEON_POOL_IDLE_TIME 30
+#define NEON_DRAIN_SIZE     (64*1024)
+
+struct neon_conn {
+    ne_session* session;
+    ne_uri purl;                        /* Server, and credentials for the auth callback */
+    gchar* proxy_host;                  /* NULL if no proxy */
+    guint proxy_port;
+    time_t idle_since;
+};
+
+static GStaticMutex pool_mutex = G_STATIC_MUTEX_INIT;
+static GQueue pool = G_QUEUE_INIT;      /* Idle connections, most recently used first */
+static GQueue active = G_QUEUE_INIT;    /* Connections in use */
+
+static void pool_cleanup(void);
+
 static gboolean neon_plugin_init(void) {
 
     gint ret;
@@ -64,6 +117,8 @@ static gboolean neon_plugin_init(void) {
  */
 
 static void neon_plugin_fini(void) {
+    pool_cleanup();
+    neon_cache_cleanup();
     ne_sock_exit();
 }
 
@@ -81,7 +136,7 @@ static struct neon_handle* handle_init(void) {
     h->reader_status.reading = FALSE;
     h->reader_status.status = NEON_READER_INIT;
 
-    if (0 != init_rb_with_lock(&(h->rb), NEON_BUFSIZE, h->reader_status.mutex)) {
+    if (0 != init_rb(&(h->rb), NEON_BUFSIZE)) {
         _ERROR("Could not initialize buffer");
         g_free(h);
         return NULL;
@@ -98,7 +153,10 @@ static struct neon_handle* handle_init(void) {
  */
 
 static void handle_free(struct neon_handle* h) {
-    _DEBUG("<%p> freeing handle", h);
+    _DEBUG("<%p> freeing handle (%u stalls)", h, h->stalls);
+
+    if (h->rate_timer != NULL)
+        g_timer_destroy(h->rate_timer);
 
     ne_uri_free(h->purl);
     g_free(h->purl);
@@ -240,7 +298,7 @@ static void kill_reader(struct neon_handle* h) {
 
     _DEBUG("Signaling reader thread to terminate");
     g_mutex_lock(h->reader_status.mutex);
-    h->reader_status.reading = FALSE;
+    g_atomic_int_set(&h->reader_status.reading, FALSE);
     g_cond_signal(h->reader_status.cond);
     g_mutex_unlock(h->reader_status.mutex);
 
@@ -256,16 +314,16 @@ static void kill_reader(struct neon_handle* h) {
 
 static int server_auth_callback(void* userdata, const char* realm, int attempt, char* username, char* password) {
 
-    struct neon_handle* h = (struct neon_handle*)userdata;
+    ne_uri* purl = (ne_uri*)userdata;
     gchar* authcpy;
     gchar** authtok;
 
-    if ((NULL == h->purl->userinfo) || ('\0' == *(h->purl->userinfo))) {
+    if ((NULL == purl->userinfo) || ('\0' == *(purl->userinfo))) {
         _ERROR("Authentication required, but no credentials set");
         return 1;
     }
 
-    if (NULL == (authcpy = g_strdup(h->purl->userinfo))) {
+    if (NULL == (authcpy = g_strdup(purl->userinfo))) {
         /*
          * No auth data
          */
@@ -413,6 +471,221 @@ static int neon_proxy_auth_cb (void * userdata, const char * realm, int attempt,
     return attempt;
 }
 
+/*
+ * -----
+ */
+
+static void create_session(struct neon_conn* c) {
+
+    ne_session* session;
+    ne_uri* purl = &c->purl;
+
+    _DEBUG("Creating session to %s://%s:%d", purl->scheme, purl->host, purl->port);
+    session = ne_session_create(purl->scheme, purl->host, purl->port);
+    ne_redirect_register(session);
+    ne_add_server_auth(session, NE_AUTH_BASIC, server_auth_callback, (void *)purl);
+    ne_set_session_flag(session, NE_SESSFLAG_ICYPROTO, 1);
+    ne_set_session_flag(session, NE_SESSFLAG_PERSIST, 1);
+
+#ifdef HAVE_NE_SET_CONNECT_TIMEOUT
+    ne_set_connect_timeout(session, 10);
+#endif
+
+    ne_set_read_timeout(session, 10);
+    ne_set_useragent(session, "Audacious/" PACKAGE_VERSION );
+
+    if (NULL != c->proxy_host) {
+        _DEBUG("Using proxy: %s:%d", c->proxy_host, c->proxy_port);
+        ne_session_proxy(session, c->proxy_host, c->proxy_port);
+
+        if (aud_get_bool (NULL, "proxy_use_auth")) {
+            _DEBUG("Using proxy authentication");
+            ne_add_proxy_auth(session, NE_AUTH_BASIC, neon_proxy_auth_cb, (void *)purl);
+        }
+    }
+
+    if (! strcmp("https", purl->scheme)) {
+        ne_ssl_trust_default_ca(session);
+        ne_ssl_set_verify(session, neon_vfs_verify_environment_ssl_certs, session);
+    }
+
+    c->session = session;
+}
+
+/*
+ * -----
+ */
+
+static gboolean conn_matches(struct neon_conn* c, ne_uri* purl, const gchar* proxy_host, guint proxy_port) {
+
+    return (! strcmp(c->purl.scheme, purl->scheme)) &&
+        (! g_ascii_strcasecmp(c->purl.host, purl->host)) &&
+        (c->purl.port == purl->port) &&
+        (! g_strcmp0(c->purl.userinfo, purl->userinfo)) &&
+        (! g_strcmp0(c->proxy_host, proxy_host)) &&
+        (c->proxy_port == proxy_port);
+}
+
+static void conn_free(struct neon_conn* c) {
+
+    _DEBUG("Closing session to %s://%s:%d", c->purl.scheme, c->purl.host, c->purl.port);
+
+    ne_session_destroy(c->session);
+    ne_uri_free(&c->purl);
+    g_free(c->proxy_host);
+    g_free(c);
+}
+
+/*
+ * Drop connections that have been idle for too long.
+ * Must be called with the pool locked.
+ */
+static void pool_expire(time_t now) {
+
+    struct neon_conn* c;
+
+    while ((NULL != (c = g_queue_peek_tail(&pool))) && (now - c->idle_since > NEON_POOL_IDLE_TIME)) {
+        conn_free(g_queue_pop_tail(&pool));
+    }
+}
+
+/*
+ * Get a session to the server in purl, from the pool if possible.
+ * Returns NULL if optional is set and the server is busy enough.
+ */
+static struct neon_conn* conn_open(ne_uri* purl, gboolean optional) {
+
+    struct neon_conn* c = NULL;
+    gchar* proxy_host = NULL;
+    guint proxy_port = 0;
+    GList* node;
+    gint busy = 0;
+
+    if (aud_get_bool (NULL, "use_proxy")) {
+        proxy_host = aud_get_string (NULL, "proxy_host");
+        proxy_port = aud_get_int (NULL, "proxy_port");
+    }
+
+    g_static_mutex_lock(&pool_mutex);
+
+    pool_expire(time(NULL));
+
+    if (optional) {
+        for (node = active.head; node != NULL; node = node->next) {
+            if (conn_matches(node->data, purl, proxy_host, proxy_port)) {
+                busy ++;
+            }
+        }
+
+        if (busy >= NEON_ACTIVE_PER_HOST) {
+            g_static_mutex_unlock(&pool_mutex);
+            _DEBUG("Not opening another session to %s://%s:%d", purl->scheme, purl->host, purl->port);
+            g_free(proxy_host);
+            return NULL;
+        }
+    }
+
+    for (node = pool.head; node != NULL; node = node->next) {
+        if (conn_matches(node->data, purl, proxy_host, proxy_port)) {
+            c = node->data;
+            g_queue_delete_link(&pool, node);
+            _DEBUG("Reusing session to %s://%s:%d", purl->scheme, purl->host, purl->port);
+            break;
+        }
+    }
+
+    if (NULL != c) {
+        g_queue_push_head(&active, c);
+        g_static_mutex_unlock(&pool_mutex);
+        g_free(proxy_host);
+        return c;
+    }
+
+    c = g_new0(struct neon_conn, 1);
+    ne_uri_copy(&c->purl, purl);
+    c->proxy_host = proxy_host;
+    c->proxy_port = proxy_port;
+    g_queue_push_head(&active, c);
+
+    g_static_mutex_unlock(&pool_mutex);
+
+    create_session(c);
+
+    return c;
+}
+
+/*
+ * Put a session back into the pool. If the last request on it was not
+ * finished cleanly, the connection itself cannot be reused and is
+ * closed, but the session is still kept for TLS session resumption.
+ */
+static void conn_close(struct neon_conn* c, gboolean clean) {
+
+    GList* node;
+    gint same = 0;
+    time_t now = time(NULL);
+
+    if (!clean) {
+        ne_close_connection(c->session);
+    }
+
+    g_static_mutex_lock(&pool_mutex);
+
+    g_queue_remove(&active, c);
+    pool_expire(now);
+
+    for (node = pool.head; node != NULL; node = node->next) {
+        if (conn_matches(node->data, &c->purl, c->proxy_host, c->proxy_port)) {
+            same ++;
+        }
+    }
+
+    if (same >= NEON_POOL_PER_HOST) {
+        conn_free(c);
+    } else {
+        c->idle_since = now;
+        g_queue_push_head(&pool, c);
+
+        while (pool.length > NEON_POOL_SIZE) {
+            conn_free(g_queue_pop_tail(&pool));
+        }
+    }
+
+    g_static_mutex_unlock(&pool_mutex);
+}
+
+static void pool_cleanup(void) {
+
+    struct neon_conn* c;
+
+    g_static_mutex_lock(&pool_mutex);
+
+    while (NULL != (c = g_queue_pop_head(&pool))) {
+        conn_free(c);
+    }
+
+    g_static_mutex_unlock(&pool_mutex);
+}
+
+/*
+ * -----
+ */
+
+static ne_request* create_request(ne_session* session, ne_uri* purl) {
+
+    ne_request* request;
+
+    if (purl->query && *(purl->query)) {
+        gchar *tmp = g_strdup_printf("%s?%s", purl->path, purl->query);
+        request = ne_request_create(session, "GET", tmp);
+        g_free(tmp);
+    } else {
+        request = ne_request_create(session, "GET", purl->path);
+    }
+
+    return request;
+}
+
 /*
  * -----
  */
@@ -422,17 +695,12 @@ static int open_request(struct neon_handle* handle, gulong startbyte) {
     int ret;
     const ne_status* status;
     ne_uri* rediruri;
+    GTimer* timer;
 
     g_return_val_if_fail(handle != NULL, -1);
     g_return_val_if_fail(handle->purl != NULL, -1);
 
-    if (handle->purl->query && *(handle->purl->query)) {
-        gchar *tmp = g_strdup_printf("%s?%s", handle->purl->path, handle->purl->query);
-        handle->request = ne_request_create(handle->session, "GET", tmp);
-        g_free(tmp);
-    } else {
-        handle->request = ne_request_create(handle->session, "GET", handle->purl->path);
-    }
+    handle->request = create_request(handle->session, handle->purl);
 
     if (0 < startbyte) {
         ne_print_request_header(handle->request, "Range", "bytes=%ld-", startbyte);
@@ -443,7 +711,10 @@ static int open_request(struct neon_handle* handle, gulong startbyte) {
      * Try to connect to the server.
      */
     _DEBUG("<%p> Connecting...", handle);
+    timer = g_timer_new();
     ret = ne_begin_request(handle->request);
+    handle->rtt = g_timer_elapsed(timer, NULL);
+    g_timer_destroy(timer);
     status = ne_get_status(handle->request);
     _DEBUG("<%p> Return: %d, Status: %d", handle, ret, status->code);
     if ((NE_OK == ret) && (401 == status->code)) {
@@ -482,6 +753,7 @@ static int open_request(struct neon_handle* handle, gulong startbyte) {
                 _DEBUG("<%p> URL opened OK", handle);
                 handle->content_start = startbyte;
                 handle->pos = startbyte;
+                handle->stream_pos = startbyte;
                 handle_headers(handle);
                 return 0;
             }
@@ -526,17 +798,6 @@ static int open_request(struct neon_handle* handle, gulong startbyte) {
 static gint open_handle(struct neon_handle* handle, gulong startbyte) {
 
     gint ret;
-    gchar* proxy_host = NULL;
-    guint proxy_port = 0;
-
-    gboolean use_proxy = aud_get_bool (NULL, "use_proxy");
-    gboolean proxy_use_auth = aud_get_bool (NULL, "proxy_use_auth");
-
-    if (use_proxy)
-    {
-        proxy_host = aud_get_string (NULL, "proxy_host");
-        proxy_port = aud_get_int (NULL, "proxy_port");
-    }
 
     handle->redircount = 0;
 
@@ -552,53 +813,27 @@ static gint open_handle(struct neon_handle* handle, gulong startbyte) {
             handle->purl->port = ne_uri_defaultport(handle->purl->scheme);
         }
 
-        _DEBUG("<%p> Creating session to %s://%s:%d", handle, handle->purl->scheme, handle->purl->host, handle->purl->port);
-        handle->session = ne_session_create(handle->purl->scheme, handle->purl->host, handle->purl->port);
-        ne_redirect_register(handle->session);
-        ne_add_server_auth(handle->session, NE_AUTH_BASIC, server_auth_callback, (void *)handle);
-        ne_set_session_flag(handle->session, NE_SESSFLAG_ICYPROTO, 1);
-        ne_set_session_flag(handle->session, NE_SESSFLAG_PERSIST, 0);
-
-#ifdef HAVE_NE_SET_CONNECT_TIMEOUT
-        ne_set_connect_timeout(handle->session, 10);
-#endif
-
-        ne_set_read_timeout(handle->session, 10);
-        ne_set_useragent(handle->session, "Audacious/" PACKAGE_VERSION );
-
-        if (use_proxy) {
-            _DEBUG("<%p> Using proxy: %s:%d", handle, proxy_host, proxy_port);
-            ne_session_proxy(handle->session, proxy_host, proxy_port);
-
-            if (proxy_use_auth) {
-                _DEBUG("<%p> Using proxy authentication", handle);
-                ne_add_proxy_auth(handle->session, NE_AUTH_BASIC, neon_proxy_auth_cb, (void *)handle);
-            }
-        }
-
-        if (! strcmp("https", handle->purl->scheme)) {
-            ne_ssl_trust_default_ca(handle->session);
-            ne_ssl_set_verify(handle->session, neon_vfs_verify_environment_ssl_certs, handle->session);
-        }
+        handle->conn = conn_open(handle->purl, FALSE);
+        handle->session = handle->conn->session;
 
         _DEBUG("<%p> Creating request", handle);
         ret = open_request(handle, startbyte);
 
         if (ret == 0)
         {
-            g_free (proxy_host);
             return 0;
         }
         else if (ret == -1)
         {
-            ne_session_destroy(handle->session);
+            conn_close(handle->conn, FALSE);
+            handle->conn = NULL;
             handle->session = NULL;
-            g_free (proxy_host);
             return -1;
         }
 
         _DEBUG("<%p> Following redirect...", handle);
-        ne_session_destroy(handle->session);
+        conn_close(handle->conn, TRUE);
+        handle->conn = NULL;
         handle->session = NULL;
     }
 
@@ -609,7 +844,6 @@ static gint open_handle(struct neon_handle* handle, gulong startbyte) {
     _ERROR ("<%p> Redirect count exceeded for URL %s", (void *) handle,
      handle->url);
 
-    g_free (proxy_host);
     return 1;
 }
 
@@ -617,14 +851,17 @@ static gint open_handle(struct neon_handle* handle, gulong startbyte) {
  * -----
  */
 
+/*
+ * Read one block from the network straight into the buffer.
+ * The buffer must not be full.
+ */
 static gint fill_buffer(struct neon_handle* h) {
 
     gssize bsize;
-    gchar buffer[NEON_NETBLKSIZE];
+    void* buffer;
     gssize to_read;
 
-    bsize = free_rb(&h->rb);
-    to_read = MIN(bsize, NEON_NETBLKSIZE);
+    to_read = MIN(write_region_rb(&h->rb, &buffer), NEON_NETBLKSIZE);
 
     if (0 >= (bsize = ne_read_response_block(h->request, buffer, to_read))) {
         if (0 == bsize) {
@@ -640,14 +877,31 @@ static gint fill_buffer(struct neon_handle* h) {
 
     _DEBUG("<%p> Read %d bytes of %d", h, (gint) bsize, (gint) to_read);
 
-    if (0 != write_rb(&(h->rb), buffer, bsize)) {
-        _ERROR ("<%p> Error putting data into buffer", (void *) h);
-        return -1;
-    }
+    commit_rb(&h->rb, bsize);
 
     return 0;
 }
 
+/*
+ * -----
+ */
+
+static guint buffer_size(struct neon_handle* h) {
+
+    gdouble rate;
+    gdouble elapsed;
+
+    if (0 < h->icy_metadata.stream_bitrate) {
+        rate = h->icy_metadata.stream_bitrate * 1000 / 8;
+    } else if ((NULL != h->rate_timer) && (1 < (elapsed = g_timer_elapsed(h->rate_timer, NULL)))) {
+        rate = h->consumed / elapsed;
+    } else {
+        rate = NEON_DEFAULT_RATE;
+    }
+
+    return CLAMP(rate * (NEON_BUFSECS + h->rtt), NEON_BUFSIZE, NEON_MAX_BUFSIZE);
+}
+
 /*
  * -----
  */
@@ -655,63 +909,155 @@ static gint fill_buffer(struct neon_handle* h) {
 static gpointer reader_thread(void* data) {
 
     struct neon_handle* h = (struct neon_handle*)data;
-    gint ret;
-
-    g_mutex_lock(h->reader_status.mutex);
+    gint ret = 0;
 
-    while(h->reader_status.reading) {
+    /*
+     * The buffer is lock-free, the mutex is only taken
+     * to go to sleep or to wake up the other thread.
+     */
+    while (g_atomic_int_get(&h->reader_status.reading)) {
 
         /*
          * Hit the network only if we have more than NEON_NETBLKSIZE of free buffer
          */
-        if (NEON_NETBLKSIZE < free_rb_locked(&h->rb)) {
-            g_mutex_unlock(h->reader_status.mutex);
-
-            ret = fill_buffer(h);
-
-            g_mutex_lock(h->reader_status.mutex);
+        if (NEON_NETBLKSIZE < free_rb(&h->rb)) {
+            if (0 != (ret = fill_buffer(h))) {
+                break;
+            }
 
             /* Wake up main thread if it is waiting. */
-            g_cond_signal (h->reader_status.cond);
-
-            if (-1 == ret) {
-                /*
-                 * Error encountered while reading from the network.
-                 * Set the error flag and terminate the
-                 * reader thread.
-                 */
-                _ERROR ("<%p> Error while reading from the network. "
-                 "Terminating reader thread", (void *) h);
-                h->reader_status.status = NEON_READER_ERROR;
-                g_mutex_unlock(h->reader_status.mutex);
-                return NULL;
-            } else if (1 == ret) {
-                /*
-                 * EOF encountered while reading from the
-                 * network. Set the EOF status and exit.
-                 */
-                _DEBUG("<%p> EOF encountered while reading from the network. Terminating reader thread", h);
-                h->reader_status.status = NEON_READER_EOF;
+            if (g_atomic_int_get(&h->reader_status.consumer_waiting)) {
+                g_mutex_lock(h->reader_status.mutex);
+                g_cond_signal(h->reader_status.cond);
                 g_mutex_unlock(h->reader_status.mutex);
-                return NULL;
             }
         } else {
             /*
              * Not enough free space in the buffer.
-             * Sleep until the main thread wakes us up.
+             * Sleep until the main thread has drained it.
              */
-            g_cond_wait(h->reader_status.cond, h->reader_status.mutex);
+            g_mutex_lock(h->reader_status.mutex);
+            g_atomic_int_set(&h->reader_status.reader_waiting, TRUE);
+
+            while (h->reader_status.reading && (free_rb(&h->rb) < NEON_WAKEMARK(h))) {
+                g_cond_wait(h->reader_status.cond, h->reader_status.mutex);
+            }
+
+            g_atomic_int_set(&h->reader_status.reader_waiting, FALSE);
+            g_mutex_unlock(h->reader_status.mutex);
         }
     }
 
-    _DEBUG("<%p> Reader thread terminating gracefully", h);
-    h->reader_status.status = NEON_READER_TERM;
+    g_mutex_lock(h->reader_status.mutex);
+
+    if (-1 == ret) {
+        /*
+         * Error encountered while reading from the network.
+         * Set the error flag and terminate the
+         * reader thread.
+         */
+        _ERROR ("<%p> Error while reading from the network. "
+         "Terminating reader thread", (void *) h);
+        h->reader_status.status = NEON_READER_ERROR;
+    } else if (1 == ret) {
+        /*
+         * EOF encountered while reading from the
+         * network. Set the EOF status and exit.
+         */
+        _DEBUG("<%p> EOF encountered while reading from the network. Terminating reader thread", h);
+        h->reader_status.status = NEON_READER_EOF;
+    } else {
+        _DEBUG("<%p> Reader thread terminating gracefully", h);
+        h->reader_status.status = NEON_READER_TERM;
+    }
+
+    g_cond_signal(h->reader_status.cond);
     g_mutex_unlock(h->reader_status.mutex);
 
     return NULL;
 }
 
 
+/*
+ * -----
+ */
+
+/*
+ * Fetch the end of the file into the cache over a second connection,
+ * leaving the current request where it is.
+ */
+static void fetch_tail(struct neon_handle* h) {
+
+    glong length = h->content_start + h->content_length;
+    gulong start = length - NEON_TAIL_SIZE;
+    gulong filled = 0;
+    gssize bsize;
+    gchar* buffer;
+    struct neon_conn* conn;
+    ne_request* request;
+    gboolean clean = FALSE;
+
+    h->tail_fetched = TRUE;
+
+    if (neon_cache_contains(h->url, length, start)) {
+        return;
+    }
+
+    if (NULL == (conn = conn_open(h->purl, TRUE))) {
+        return;
+    }
+
+    buffer = g_malloc(NEON_TAIL_SIZE);
+    request = create_request(conn->session, h->purl);
+    ne_print_request_header(request, "Range", "bytes=%lu-", start);
+
+    if ((NE_OK == ne_begin_request(request)) && (206 == ne_get_status(request)->code)) {
+        while ((filled < NEON_TAIL_SIZE) && (0 < (bsize = ne_read_response_block(request, buffer + filled, NEON_TAIL_SIZE - filled)))) {
+            filled += bsize;
+        }
+
+        if (filled == NEON_TAIL_SIZE) {
+            _DEBUG("<%p> Fetched %u bytes at %lu", h, NEON_TAIL_SIZE, start);
+            neon_cache_store(h->url, length, start, buffer, NEON_TAIL_SIZE);
+            clean = (NE_OK == ne_end_request(request));
+        }
+    } else {
+        _DEBUG("<%p> Could not fetch the end of the file", h);
+    }
+
+    ne_request_destroy(request);
+    conn_close(conn, clean);
+    g_free(buffer);
+}
+
+/*
+ * End the current request and give the session back to the pool.
+ * The reader thread must not be running.
+ */
+static void close_request(struct neon_handle* h) {
+
+    gboolean clean = FALSE;
+    glong left;
+
+    if (NULL != h->request) {
+        left = h->content_start + h->content_length - (h->stream_pos + used_rb(&h->rb));
+
+        if ((-1 != h->content_length) && (left <= NEON_DRAIN_SIZE)) {
+            _DEBUG("<%p> Reading the remaining %ld bytes to keep the connection", h, left);
+            clean = (NE_OK == ne_end_request(h->request));
+        }
+
+        ne_request_destroy(h->request);
+        h->request = NULL;
+    }
+
+    if (NULL != h->conn) {
+        conn_close(h->conn, clean);
+        h->conn = NULL;
+        h->session = NULL;
+    }
+}
+
 /*
  * -----
  */
@@ -737,6 +1083,8 @@ void * neon_vfs_fopen_impl (const gchar * path, const gchar * mode)
         return NULL;
     }
 
+    handle->caching = handle->can_ranges && (-1 != handle->content_length) && (0 == handle->icy_metaint);
+
     return handle;
 }
 
@@ -752,15 +1100,8 @@ gint neon_vfs_fclose_impl(VFSFile* file) {
         kill_reader(h);
     }
 
-    _DEBUG("<%p> Destroying request", h);
-    if (NULL != h->request) {
-        ne_request_destroy(h->request);
-    }
-
-    _DEBUG("<%p> Destroying session", h);
-    if (NULL != h->session) {
-        ne_session_destroy(h->session);
-    }
+    _DEBUG("<%p> Closing request", h);
+    close_request(h);
 
     handle_free(h);
 
@@ -790,20 +1131,28 @@ static gint64 neon_fread_real (void * ptr_, gint64 size, gint64 nmemb,
     if (h->eof)
         return 0;
 
-    /* If the buffer is empty, wait for the reader thread to fill it. */
-    g_mutex_lock (h->reader_status.mutex);
+    if (NULL == h->rate_timer)
+        h->rate_timer = g_timer_new ();
 
-    for (retries = 0; retries < NEON_RETRY_COUNT; retries ++)
+    /* If the buffer is empty, wait for the reader thread to fill it. */
+    if (used_rb (& h->rb) / size == 0 && h->reader != NULL)
     {
-        if (used_rb_locked (& h->rb) / size > 0 || h->reader == NULL ||
-         h->reader_status.status != NEON_READER_RUN)
-            break;
+        g_mutex_lock (h->reader_status.mutex);
+        g_atomic_int_set (& h->reader_status.consumer_waiting, TRUE);
+        h->stalls ++;
 
-        g_cond_signal (h->reader_status.cond);
-        g_cond_wait (h->reader_status.cond, h->reader_status.mutex);
-    }
+        for (retries = 0; retries < NEON_RETRY_COUNT; retries ++)
+        {
+            if (used_rb (& h->rb) / size > 0 ||
+             h->reader_status.status != NEON_READER_RUN)
+                break;
+
+            g_cond_wait (h->reader_status.cond, h->reader_status.mutex);
+        }
 
-    g_mutex_unlock (h->reader_status.mutex);
+        g_atomic_int_set (& h->reader_status.consumer_waiting, FALSE);
+        g_mutex_unlock (h->reader_status.mutex);
+    }
 
     if (NULL == h->reader) {
         if ((NEON_READER_EOF != h->reader_status.status) ||
@@ -830,6 +1179,15 @@ static gint64 neon_fread_real (void * ptr_, gint64 size, gint64 nmemb,
              */
             g_mutex_lock(h->reader_status.mutex);
             if (0 == ret) {
+                /*
+                 * The reader thread is not running, so this is the
+                 * time to adapt the buffer to the stream.
+                 */
+                if (0 != resize_rb(&h->rb, buffer_size(h))) {
+                    _ERROR ("<%p> Could not resize buffer", (void *) h);
+                }
+
+                _DEBUG("<%p> Buffer size: %u", h, h->rb.size);
                 h->reader_status.reading = TRUE;
                 _DEBUG("<%p> Starting reader thread", h);
                 if (NULL == (h->reader = g_thread_create(reader_thread, h, TRUE, NULL))) {
@@ -879,7 +1237,7 @@ static gint64 neon_fread_real (void * ptr_, gint64 size, gint64 nmemb,
                  * If there still is data in the buffer, carry on.
                  * If not, terminate the reader thread and return 0.
                  */
-                if (0 == used_rb_locked(&h->rb)) {
+                if (0 == used_rb(&h->rb)) {
                     _DEBUG("<%p> Reached end of stream", h);
                     g_mutex_unlock(h->reader_status.mutex);
 
@@ -962,45 +1320,120 @@ static gint64 neon_fread_real (void * ptr_, gint64 size, gint64 nmemb,
     read_rb(&h->rb, ptr_, relem*size);
 
     /*
-     * Signal the network thread to continue reading
+     * Signal the network thread to continue reading, once enough
+     * of the buffer is free to make it worthwhile
      */
+    if (g_atomic_int_get(&h->reader_status.reader_waiting) &&
+        (NEON_WAKEMARK(h) <= free_rb(&h->rb))) {
+        g_mutex_lock(h->reader_status.mutex);
+        g_cond_signal(h->reader_status.cond);
+        g_mutex_unlock(h->reader_status.mutex);
+    }
+
     g_mutex_lock(h->reader_status.mutex);
     if (NEON_READER_EOF == h->reader_status.status) {
-        if (0 == free_rb_locked(&h->rb)) {
+        if (0 == free_rb(&h->rb)) {
             _DEBUG("<%p> stream EOF reached and buffer empty", h);
             h->eof = TRUE;
         }
     }
-    else
-        g_cond_signal(h->reader_status.cond);
-
     g_mutex_unlock(h->reader_status.mutex);
 
     h->pos += (relem*size);
+    h->consumed += (relem*size);
     h->icy_metaleft -= (relem*size);
 
     return relem;
 }
 
+/*
+ * -----
+ */
+
+static gint reopen_handle(struct neon_handle* h, gulong newpos) {
+
+    /*
+     * To seek to the new position we have to
+     * - stop the current reader thread, if there is one
+     * - destroy the current request
+     * - dump all data currently in the ringbuffer
+     * - create a new request starting at newpos
+     */
+    if (NULL != h->reader) {
+        /*
+         * There may be a thread still running.
+         */
+        kill_reader(h);
+    }
+
+    close_request(h);
+    reset_rb(&h->rb);
+
+    if (0 != open_handle(h, newpos)) {
+        /*
+         * Something went wrong while creating the new request.
+         * There is not much we can do now, we'll set the request
+         * to NULL, so that fread() will error out on the next
+         * read request
+         */
+        _ERROR ("<%p> Error while creating new request!", (void *) h);
+        h->request = NULL;
+        return -1;
+    }
+
+    /*
+     * Things seem to have worked. The next read request will start
+     * the reader thread again.
+     */
+    h->eof = FALSE;
+
+    return 0;
+}
+
 /* neon_fread_real will do only a partial read if the buffer underruns, so we
- * must call it repeatedly until we have read the full request. */
+ * must call it repeatedly until we have read the full request.  After a seek,
+ * data is taken from the cache for as long as it has some; the network is
+ * only asked for the rest. */
 gint64 neon_vfs_fread_impl (void * buffer, gint64 size, gint64 count,
  VFSFile * handle)
 {
+    struct neon_handle* h = (struct neon_handle *) vfs_get_handle (handle);
+    glong length = h->content_start + h->content_length;
+    gsize goal = size * count;
     gsize total = 0, new;
 
     _DEBUG ("<%p> fread %d x %d", (void *) handle, (gint) size, (gint) count);
 
-    while (count > 0 && (new = neon_fread_real (buffer, size, count, handle)) > 0)
+    while (total < goal && ! h->eof)
     {
-        buffer = (gchar *) buffer + size * new;
+        gchar * dest = (gchar *) buffer + total;
+
+        if (h->pos != h->stream_pos)
+        {
+            if ((new = neon_cache_fetch (h->url, length, h->pos, dest, goal - total)) > 0)
+            {
+                h->pos += new;
+                total += new;
+                continue;
+            }
+
+            if (reopen_handle (h, h->pos) != 0)
+                break;
+        }
+
+        if ((new = neon_fread_real (dest, 1, goal - total, handle)) == 0)
+            break;
+
+        if (h->caching)
+            h->caching = neon_cache_store (h->url, length, h->pos - new, dest, new);
+
+        h->stream_pos = h->pos;
         total += new;
-        count -= new;
     }
 
     _DEBUG ("<%p> fread = %d", (void *) handle, (gint) total);
 
-    return total;
+    return (size > 0) ? total / size : 0;
 }
 
 /*
@@ -1132,48 +1565,26 @@ gint neon_vfs_fseek_impl (VFSFile * file, gint64 offset, gint whence)
         return 0;
     }
 
-    /*
-     * To seek to the new position we have to
-     * - stop the current reader thread, if there is one
-     * - destroy the current request
-     * - dump all data currently in the ringbuffer
-     * - create a new request starting at newpos
-     */
-    if (NULL != h->reader) {
-        /*
-         * There may be a thread still running.
-         */
-        kill_reader(h);
-    }
-
-    if (NULL != h->request) {
-        ne_request_destroy(h->request);
-    }
-    if (NULL != h->session) {
-        ne_session_destroy(h->session);
-        h->session = NULL;
-    }
-    reset_rb(&h->rb);
-
-    if (0 != open_handle(h, newpos)) {
-        /*
-         * Something went wrong while creating the new request.
-         * There is not much we can do now, we'll set the request
-         * to NULL, so that fread() will error out on the next
-         * read request
-         */
-        _ERROR ("<%p> Error while creating new request!", (void *) h);
-        h->request = NULL;
-        return -1;
+    /* Decoders looking for tags usually come back, so keep the stream */
+    if (h->caching && !h->tail_fetched && (content_length >= 2 * NEON_TAIL_SIZE) &&
+     (newpos >= content_length - NEON_TAIL_SIZE) && (newpos != h->stream_pos)) {
+        fetch_tail(h);
     }
 
     /*
-     * Things seem to have worked. The next read request will start
-     * the reader thread again.
+     * No need to touch the network if the data at the new position
+     * is cached, or if the network stream is positioned there anyway.
+     * fread() reconnects if it runs out of cached data.
      */
-    h->eof = FALSE;
 
-    return 0;
+    if (((newpos == h->stream_pos) && (NULL != h->request)) || neon_cache_contains(h->url, content_length, newpos)) {
+        _DEBUG("<%p> Seeking within cached data", h);
+        h->pos = newpos;
+        h->eof = FALSE;
+        return 0;
+    }
+
+    return reopen_handle(h, newpos);
 }
 
 void neon_vfs_rewind_impl(VFSFile* file) {
@@ -40,7 +40,9 @@ typedef enum {
 struct reader_status {
     GMutex* mutex;
     GCond* cond;
-    gboolean reading;
+    volatile gint reading;
+    volatile gint reader_waiting;       /* The reader thread sleeps until the buffer drains */
+    volatile gint consumer_waiting;     /* The main thread sleeps until data arrives */
     neon_reader_t status;
 };
 
@@ -52,6 +54,8 @@ struct icy_metadata {
     gint   stream_bitrate;
 };
 
+struct neon_conn;
+
 struct neon_handle {
     gchar* url;                         /* The URL, as passed to us */
     ne_uri* purl;                       /* The URL, parsed into a structure */
@@ -64,11 +68,19 @@ struct neon_handle {
     gulong icy_metaint;                 /* Interval in which the server will send metadata announcements. 0 if no announcments */
     gulong icy_metaleft;                /* Bytes left until the next metadata block */
     struct icy_metadata icy_metadata;   /* Current ICY metadata */
+    struct neon_conn* conn;             /* Pooled connection the session belongs to */
     ne_session* session;
     ne_request* request;
     GThread* reader;
     struct reader_status reader_status;
     gboolean eof;
+    gdouble rtt;                        /* Time taken by the server to answer the last request, in seconds */
+    GTimer* rate_timer;                 /* Running since the first read */
+    guint64 consumed;                   /* Bytes delivered to the player */
+    guint stalls;                       /* Number of times the player had to wait for the network */
+    gulong stream_pos;                  /* Position of the next byte from the network; differs from pos while reading from the cache */
+    gboolean caching;                   /* Data read from the network goes to the cache */
+    gboolean tail_fetched;              /* The end of the file was fetched into the cache */
 };
 
 
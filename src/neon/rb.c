@@ -23,6 +23,9 @@
 #include "rb.h"
 #include "debug.h"
 
+#define RB_WP(rb) ((unsigned int) g_atomic_int_get(&(rb)->wp))
+#define RB_RP(rb) ((unsigned int) g_atomic_int_get(&(rb)->rp))
+
 #ifdef RB_DEBUG
 /*
  * An internal assertion function to make sure that the
@@ -33,15 +36,17 @@
  */
 static void _assert_rb(struct ringbuf* rb) {
 
-    unsigned int realused;
+    unsigned int used;
 
     _ENTER;
 
-    _DEBUG("rb->buf=%p, rb->end=%p, rb->wp=%p, rb->rp=%p, rb->free=%u, rb->used=%u, rb->size=%u",
-            rb->buf, rb->end, rb->wp, rb->rp, rb->free, rb->used, rb->size);
+    used = RB_WP(rb) - RB_RP(rb);
+
+    _DEBUG("rb->buf=%p, rb->wp=%u, rb->rp=%u, used=%u, rb->size=%u",
+            rb->buf, RB_WP(rb), RB_RP(rb), used, rb->size);
 
-    if (0 == rb->size) {
-        _ERROR("Buffer size is 0");
+    if (0 == rb->size || 0 != (rb->size & (rb->size - 1))) {
+        _ERROR("Buffer size is not a power of two");
         abort();
     }
 
@@ -50,40 +55,28 @@ static void _assert_rb(struct ringbuf* rb) {
         abort();
     }
 
-    if (rb->used+rb->free != rb->size) {
-        _ERROR("rb->free and rb->used do not add up to rb->size");
+    if (used > rb->size) {
+        _ERROR("Usage count is inconsistient (is %u, size is %u)", used, rb->size);
         abort();
     }
 
-    if (rb->buf+(rb->size-1) != rb->end) {
-        _ERROR("rb->buf and rb->end not rb->size bytes apart");
-        abort();
-    }
-
-    if ((rb->wp < rb->buf) || (rb->wp > rb->end)) {
-        _ERROR("Write pointer outside buffer space");
-        abort();
-    }
+    _LEAVE;
+}
+#endif
 
-    if ((rb->rp < rb->buf) || (rb->rp > rb->end)) {
-        _ERROR("Read pointer outside buffer space");
-        abort();
-    }
+/*
+ * Round a buffer size up to the next power of two
+ */
+static unsigned int round_size(unsigned int size) {
 
-    if (rb->rp <= rb->wp) {
-        realused = rb->wp - rb->rp;
-    } else {
-        realused = (rb->end - rb->rp) + 1 + (rb->wp-rb->buf);
-    }
+    unsigned int r = 1;
 
-    if (rb->used != realused) {
-        _ERROR("Usage count is inconsistient (is %d, should be %d)", rb->used, realused);
-        abort();
+    while (r < size && r < (1u << 31)) {
+        r <<= 1;
     }
 
-    _LEAVE;
+    return r;
 }
-#endif
 
 /*
  * Reset a ringbuffer structure (i.e. discard
@@ -93,22 +86,16 @@ void reset_rb(struct ringbuf* rb) {
 
     _ENTER;
 
-    _RB_LOCK(rb->lock);
-
-    rb->wp = rb->buf;
-    rb->rp = rb->buf;
-    rb->free = rb->size;
-    rb->used = 0;
-    rb->end = rb->buf+(rb->size-1);
-
-    _RB_UNLOCK(rb->lock);
+    g_atomic_int_set(&rb->wp, 0);
+    g_atomic_int_set(&rb->rp, 0);
 
     _LEAVE;
 }
 
 /*
  * Initialize a ringbuffer structure (including
- * memory allocation.
+ * memory allocation). The size is rounded up to
+ * a power of two.
  *
  * Return -1 on error
  */
@@ -120,27 +107,13 @@ int init_rb(struct ringbuf* rb, unsigned int size) {
         _LEAVE -1;
     }
 
+    size = round_size(size);
+
     if (NULL == (rb->buf = malloc(size))) {
         _LEAVE -1;
     }
     rb->size = size;
 
-#ifdef _RB_USE_GLIB
-    if (NULL == (rb->lock = g_mutex_new())) {
-        _LEAVE -1;
-    }
-#else
-    if (NULL == (rb->lock = malloc(sizeof(pthread_mutex_t)))) {
-        _LEAVE -1;
-    }
-
-    if (0 != pthread_mutex_init(rb->lock, NULL)) {
-        free(rb->lock);
-        _LEAVE -1;
-    }
-#endif
-    rb->_free_lock = 1;
-
     reset_rb(rb);
 
     ASSERT_RB(rb);
@@ -149,89 +122,125 @@ int init_rb(struct ringbuf* rb, unsigned int size) {
 }
 
 /*
- * Initialize a ringbuffer structure (including
- * memory allocation.
- * The mutex to be used is passed in the function call.
- * The mutex must not be held while calling this function.
+ * Change the size of a ringbuffer, keeping the data
+ * inside of it. The size is rounded up to a power of two,
+ * and must be large enough to hold the data.
  *
  * Return -1 on error
  */
-int init_rb_with_lock(struct ringbuf* rb, unsigned int size, rb_mutex_t* lock) {
+int resize_rb(struct ringbuf* rb, unsigned int size) {
+
+    char* buf;
+    unsigned int used;
 
     _ENTER;
 
-    if (0 == size) {
-        _LEAVE -1;
+    size = round_size(size);
+    used = used_rb(rb);
+
+    if (size == rb->size) {
+        _LEAVE 0;
     }
 
-    rb->lock = lock;
-    rb->_free_lock = 0;
+    if (size < used) {
+        _LEAVE -1;
+    }
 
-    if (NULL == (rb->buf = malloc(size))) {
+    if (NULL == (buf = malloc(size))) {
         _LEAVE -1;
     }
+
+    read_rb(rb, buf, used);
+    free(rb->buf);
+
+    rb->buf = buf;
     rb->size = size;
-    reset_rb(rb);
+    g_atomic_int_set(&rb->rp, 0);
+    g_atomic_int_set(&rb->wp, (gint) used);
 
     ASSERT_RB(rb);
 
     _LEAVE 0;
 }
 
+/*
+ * Return the largest contiguous free area at the write
+ * position in buf, and its size. Data placed there
+ * becomes visible to the reader with commit_rb().
+ */
+unsigned int write_region_rb(struct ringbuf* rb, void** buf) {
+
+    unsigned int wp;
+    unsigned int endfree;
+    unsigned int f;
+
+    _ENTER;
+
+    wp = RB_WP(rb);
+    f = rb->size - (wp - RB_RP(rb));
+    endfree = rb->size - (wp & (rb->size - 1));
+
+    *buf = rb->buf + (wp & (rb->size - 1));
+
+    _LEAVE MIN(f, endfree);
+}
+
+/*
+ * Make size bytes placed in the area returned by
+ * write_region_rb() visible to the reader.
+ */
+void commit_rb(struct ringbuf* rb, unsigned int size) {
+
+    _ENTER;
+
+    g_atomic_int_set(&rb->wp, (gint) (RB_WP(rb) + size));
+
+    ASSERT_RB(rb);
+
+    _LEAVE;
+}
+
 /*
  * Write size bytes at buf into the ringbuffer.
  * Return -1 on error (not enough space in buffer)
  */
 int write_rb(struct ringbuf* rb, void* buf, unsigned int size) {
 
-    int ret = -1;
-    int endfree;
+    unsigned int wp;
+    unsigned int offset;
+    unsigned int endfree;
 
     _ENTER;
 
-    _RB_LOCK(rb->lock);
-
     ASSERT_RB(rb);
 
-    if (rb->free < size) {
-        ret = -1;
-        goto out;
+    if (free_rb(rb) < size) {
+        _LEAVE -1;
     }
 
-    endfree = (rb->end - rb->wp)+1;
+    wp = RB_WP(rb);
+    offset = wp & (rb->size - 1);
+    endfree = rb->size - offset;
+
     if (endfree < size) {
         /*
          * There is enough space in the buffer, but not in
          * one piece. We need to split the copy into two parts.
          */
-        memcpy(rb->wp, buf, endfree);
+        memcpy(rb->buf + offset, buf, endfree);
         memcpy(rb->buf, (char *) buf + endfree, size - endfree);
-        rb->wp = rb->buf + (size-endfree);
-    } else if (endfree > size) {
-        /*
-         * There is more space than needed at the end
-         */
-        memcpy(rb->wp, buf, size);
-        rb->wp += size;
     } else {
-        /*
-         * There is exactly the space needed at the end.
-         * We need to wrap around the read pointer.
-         */
-        memcpy(rb->wp, buf, size);
-        rb->wp = rb->buf;
+        memcpy(rb->buf + offset, buf, size);
     }
 
-    rb->free -= size;
-    rb->used += size;
+    /*
+     * Publish the data only after it has been copied
+     */
+    g_atomic_int_set(&rb->wp, (gint) (wp + size));
 
-    ret = 0;
-
-out:
     ASSERT_RB(rb);
-    _RB_UNLOCK(rb->lock);
 
-    _LEAVE ret;
+    _LEAVE 0;
 }
 
 /*
@@ -240,65 +249,37 @@ out:
  */
 int read_rb(struct ringbuf* rb, void* buf, unsigned int size) {
 
-    int ret;
-
-    _ENTER;
-
-    _RB_LOCK(rb->lock);
-    ret = read_rb_locked(rb, buf, size);
-    _RB_UNLOCK(rb->lock);
-
-    _LEAVE ret;
-}
-
-/*
- * Read size bytes from buffer into buf, assuming the buffer lock
- * is already held.
- * Return -1 on error (not enough data in buffer)
- */
-int read_rb_locked(struct ringbuf* rb, void* buf, unsigned int size) {
-
-    int endused;
+    unsigned int rp;
+    unsigned int offset;
+    unsigned int endused;
 
     _ENTER;
 
     ASSERT_RB(rb);
 
-    if (rb->used < size) {
+    if (used_rb(rb) < size) {
         /* Not enough bytes in buffer */
         _LEAVE -1;
     }
 
-    if (rb->rp < rb->wp) {
-        /*
-        Read pointer is behind write pointer, all the data is available in one chunk
-        */
-        memcpy(buf, rb->rp, size);
-        rb->rp += size;
-    } else {
+    rp = RB_RP(rb);
+    offset = rp & (rb->size - 1);
+    endused = rb->size - offset;
+
+    if (endused < size) {
         /*
-         * Read pointer is before write pointer
+         * There is enough data in the buffer, but it is fragmented.
          */
-        endused = (rb->end - rb->rp)+1;
-
-        if (size < endused) {
-            /*
-             * Data is available in one chunk
-             */
-            memcpy(buf, rb->rp, size);
-            rb->rp += size;
-        } else {
-            /*
-             * There is enough data in the buffer, but it is fragmented.
-             */
-            memcpy(buf, rb->rp, endused);
-            memcpy((char *) buf + endused, rb->buf, size - endused);
-            rb->rp = rb->buf + (size-endused);
-        }
+        memcpy(buf, rb->buf + offset, endused);
+        memcpy((char *) buf + endused, rb->buf, size - endused);
+    } else {
+        memcpy(buf, rb->buf + offset, size);
     }
 
-    rb->free += size;
-    rb->used -= size;
+    /*
+     * Hand the space back to the writer only after the copy
+     */
+    g_atomic_int_set(&rb->rp, (gint) (rp + size));
 
     ASSERT_RB(rb);
 
@@ -310,57 +291,21 @@ int read_rb_locked(struct ringbuf* rb, void* buf, unsigned int size) {
  */
 unsigned int free_rb(struct ringbuf* rb) {
 
-    unsigned int f;
-
     _ENTER;
 
-    _RB_LOCK(rb->lock);
-    f = free_rb_locked(rb);
-    _RB_UNLOCK(rb->lock);
-
-    _LEAVE f;
+    _LEAVE rb->size - used_rb(rb);
 }
 
-/*
- * Return the amount of free space currently in the rb.
- * Assume the rb lock is already being held.
- */
-unsigned int free_rb_locked(struct ringbuf* rb) {
-
-    _ENTER;
-
-    _LEAVE rb->free;
-}
-
-
 /*
  * Return the amount of used space currently in the rb
  */
 unsigned int used_rb(struct ringbuf* rb) {
 
-    unsigned int u;
-
     _ENTER;
 
-    _RB_LOCK(rb->lock);
-    u = used_rb_locked(rb);
-    _RB_UNLOCK(rb->lock);
-
-    _LEAVE u;
+    _LEAVE RB_WP(rb) - RB_RP(rb);
 }
 
-/*
- * Return the amount of used space currently in the rb.
- * Assume the rb lock is already being held.
- */
-unsigned int used_rb_locked(struct ringbuf* rb) {
-
-    _ENTER;
-
-    _LEAVE rb->used;
-}
-
-
 /*
  * destroy a ringbuffer
  */
@@ -368,14 +313,6 @@ void destroy_rb(struct ringbuf* rb) {
 
     _ENTER;
     free(rb->buf);
-    if (rb->_free_lock) {
-#ifdef _RB_USE_GLIB
-        g_mutex_free(rb->lock);
-#else
-        pthread_mutex_destroy(rb->lock);
-        free(rb->lock);
-#endif
-    }
 
     _LEAVE;
 }
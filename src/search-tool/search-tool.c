@@ -22,6 +22,7 @@
 
 #include <gtk/gtk.h>
 
+#include <audacious/debug.h>
 #include <audacious/i18n.h>
 #include <audacious/misc.h>
 #include <audacious/playlist.h>
@@ -37,70 +38,86 @@
 
 enum {ARTIST, ALBUM, TITLE, FIELDS};
 
-typedef struct item {
+typedef struct {
     int field;
-    char * name, * folded;
-    struct item * parent;
-    GHashTable * children;
-    GArray * matches;
+    int name, folded; /* offsets into the string table */
+    int parent; /* item id, -1 for artists */
+    int children, n_children; /* range of item ids */
+    int matches, n_matches; /* range of the matches array */
 } Item;
 
+/* The database is built on a worker thread and not changed afterward.  Items
+ * are laid out level by level (artists, then albums, then titles), so that the
+ * children of each item are contiguous. */
+typedef struct {
+    char * strings; /* name and folded name of each item, NUL-terminated */
+    int strings_size;
+
+    Item * items;
+    int n_items, n_artists;
+
+    int * matches; /* playlist entries of each item, in playlist order */
+    int n_matches;
+
+    int * entry_items; /* title item of each playlist entry, or -1 */
+    int n_entries;
+
+    /* trigram index: for the trigram trigrams[t], trigram_ids from
+     * trigram_start[t] to trigram_start[t + 1] are the (ascending) ids of the
+     * items containing it in their folded names */
+    unsigned * trigrams;
+    int * trigram_start;
+    int * trigram_ids;
+    int n_trigrams;
+} Database;
+
 typedef struct {
+    GArray * sets[32]; /* ids of items matching each search term */
+    int n_sets, pivot;
     Index * items[FIELDS];
-    int mask;
+    int full; /* number of fields with more than MAX_RESULTS items */
 } SearchState;
 
+typedef struct {
+    GThread * thread;
+    int list_id;
+    volatile int cancel;
+    Database * database;
+} BuildJob;
+
 static int playlist_id;
 static char * * search_terms;
 
 static GHashTable * added_table;
-static GHashTable * database;
+static Database * database;
+static BuildJob * build_job;
+static GSList * stale_jobs; /* cancelled, but still running */
 static Index * items;
 static GArray * selection;
 
+/* search term -> GArray of ids of items matching it, ascending; only terms of
+ * the current and previous searches are kept */
+static GHashTable * term_cache;
+
 static bool_t adding;
 static int search_source;
 
 static GtkWidget * entry, * help_label, * wait_label, * scrolled, * results_list;
 
-static void item_free (Item * item);
-
 /* str_unref() may be a macro */
 static void str_unref_cb (void * str)
 {
     str_unref (str);
 }
 
-static Item * item_new (int field, char * name, Item * parent)
-{
-    Item * item = g_slice_new (Item);
-    item->field = field;
-    item->name = name;
-    item->folded = g_utf8_casefold (name, -1);
-    item->parent = parent;
-    item->matches = g_array_new (FALSE, FALSE, sizeof (int));
+static void destroy_database (void);
+static void schedule_search (void);
+static void show_hide_widgets (void);
 
-    /* speed things up by using g_direct_equal() instead of g_str_equal()
-       because identical pooled strings have the same pointer */
-    if (field == TITLE)
-        item->children = NULL;
-    else
-        item->children = g_hash_table_new_full (g_str_hash, g_direct_equal,
-         NULL, (GDestroyNotify) item_free);
-
-    return item;
-}
-
-static void item_free (Item * item)
-{
-    if (item->children)
-        g_hash_table_destroy (item->children);
-
-    str_unref (item->name);
-    g_free (item->folded);
-    g_array_free (item->matches, TRUE);
-    g_slice_free (Item, item);
-}
+#define ITEM(id) (& database->items[id])
+#define ITEM_NAME(item) (database->strings + (item)->name)
+#define ITEM_FOLDED(item) (database->strings + (item)->folded)
+#define ITEM_ID(item) ((int) ((item) - database->items))
 
 static void find_playlist (void)
 {
@@ -180,123 +197,685 @@ static void destroy_added_table (void)
     }
 }
 
-static void destroy_database (void)
+#define TRIGRAM(s) (((unsigned char) (s)[0] << 16) | \
+ ((unsigned char) (s)[1] << 8) | (unsigned char) (s)[2])
+
+static void id_array_free (void * array)
 {
-    if (items)
-        index_delete (items, 0, index_count (items));
+    g_array_free (array, TRUE);
+}
 
-    if (database)
+static bool_t has_id (GArray * ids, int id)
+{
+    int low = 0, high = ids->len;
+
+    while (low < high)
     {
-        g_hash_table_destroy (database);
-        database = NULL;
+        int mid = (low + high) / 2;
+        int val = g_array_index (ids, int, mid);
+
+        if (val == id)
+            return TRUE;
+
+        if (val < id)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return FALSE;
+}
+
+/* temporary tree used while building the database */
+typedef struct node {
+    char * name; /* pooled */
+    GHashTable * children;
+    GArray * matches;
+    int id, children_start, n_children;
+    struct node * parent;
+} Node;
+
+static void node_free (Node * node)
+{
+    if (node->children)
+        g_hash_table_destroy (node->children);
+
+    str_unref (node->name);
+    g_array_free (node->matches, TRUE);
+    g_slice_free (Node, node);
+}
+
+/* takes ownership of the reference to <name> */
+static Node * get_child (GHashTable * table, char * name, Node * parent,
+ bool_t leaf)
+{
+    Node * node = g_hash_table_lookup (table, name);
+
+    if (node)
+    {
+        str_unref (name);
+        return node;
     }
+
+    node = g_slice_new0 (Node);
+    node->name = name;
+    node->matches = g_array_new (FALSE, FALSE, sizeof (int));
+    node->parent = parent;
+
+    /* identical pooled strings have the same pointer */
+    if (! leaf)
+        node->children = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+         NULL, (GDestroyNotify) node_free);
+
+    g_hash_table_insert (table, name, node);
+    return node;
 }
 
-static void create_database (int list)
+/* returns FALSE (and drops the references) if the entry has no title */
+static bool_t describe_entry (int list, int entry, char * * title,
+ char * * artist, char * * album)
 {
-    destroy_database ();
+    aud_playlist_entry_describe (list, entry, title, artist, album, TRUE);
 
-    /* speed things up by using g_direct_equal() instead of g_str_equal()
-       because identical pooled strings have the same pointer */
-    database = g_hash_table_new_full (g_str_hash, g_direct_equal, NULL,
-     (GDestroyNotify) item_free);
+    if (! * title)
+    {
+        str_unref (* artist);
+        str_unref (* album);
+        return FALSE;
+    }
+
+    if (! * artist)
+        * artist = str_get (_("Unknown Artist"));
+    if (! * album)
+        * album = str_get (_("Unknown Album"));
+
+    return TRUE;
+}
+
+static void append_node_cb (void * key, void * node, void * order)
+{
+    ((Node *) node)->id = ((GPtrArray *) order)->len;
+    g_ptr_array_add (order, node);
+}
+
+static int compare_unsigned (const void * _a, const void * _b)
+{
+    unsigned a = * (const unsigned *) _a, b = * (const unsigned *) _b;
+    return (a > b) - (a < b);
+}
+
+/* builds the trigram index in two passes: count, then fill */
+/* returns FALSE if cancelled */
+static bool_t index_trigrams (Database * db, volatile int * cancel)
+{
+    GHashTable * slots = g_hash_table_new (g_direct_hash, g_direct_equal);
+    GArray * keys = g_array_new (FALSE, FALSE, sizeof (unsigned));
+    GArray * counts = g_array_new (FALSE, TRUE, sizeof (int));
+    GArray * last = g_array_new (FALSE, FALSE, sizeof (int));
+
+    for (int pass = 0; pass < 2; pass ++)
+    {
+        for (int id = 0; id < db->n_items; id ++)
+        {
+            if (! (id & 1023) && g_atomic_int_get (cancel))
+                break;
+
+            const char * folded = db->strings + db->items[id].folded;
+            int len = strlen (folded);
+
+            for (int i = 0; i + 3 <= len; i ++)
+            {
+                unsigned key = TRIGRAM (folded + i);
+                void * value;
+                int slot;
+
+                if (g_hash_table_lookup_extended (slots, GUINT_TO_POINTER (key),
+                 NULL, & value))
+                    slot = GPOINTER_TO_INT (value);
+                else
+                {
+                    int none = -1;
+                    slot = keys->len;
+                    g_array_append_val (keys, key);
+                    g_array_append_val (last, none);
+                    g_array_set_size (counts, keys->len);
+                    g_hash_table_insert (slots, GUINT_TO_POINTER (key),
+                     GINT_TO_POINTER (slot));
+                }
+
+                /* count each item only once per trigram */
+                if (g_array_index (last, int, slot) == id)
+                    continue;
+
+                g_array_index (last, int, slot) = id;
+
+                if (pass)
+                    db->trigram_ids[db->trigram_start[slot] ++] = id;
+                else
+                    g_array_index (counts, int, slot) ++;
+            }
+        }
+
+        if (pass || g_atomic_int_get (cancel))
+            break;
+
+        /* sort the trigrams so that they can be found by binary search */
+        int n = keys->len;
+        unsigned * sorted = g_memdup (keys->data, sizeof (unsigned) * n);
+        qsort (sorted, n, sizeof (unsigned), compare_unsigned);
+
+        db->n_trigrams = n;
+        db->trigrams = sorted;
+        db->trigram_start = g_new (int, n + 1);
+
+        int total = 0;
+
+        for (int t = 0; t < n; t ++)
+        {
+            int slot = GPOINTER_TO_INT (g_hash_table_lookup (slots,
+             GUINT_TO_POINTER (sorted[t])));
+
+            db->trigram_start[t] = total;
+            total += g_array_index (counts, int, slot);
+
+            /* the second pass fills in sorted order */
+            g_hash_table_insert (slots, GUINT_TO_POINTER (sorted[t]),
+             GINT_TO_POINTER (t));
+            g_array_index (last, int, t) = -1;
+        }
+
+        db->trigram_start[n] = total;
+        db->trigram_ids = g_new (int, total);
+    }
+
+    /* the second pass left each start pointing at the next list's start */
+    for (int t = db->n_trigrams; t > 0; t --)
+        db->trigram_start[t] = db->trigram_start[t - 1];
+    if (db->n_trigrams)
+        db->trigram_start[0] = 0;
+
+    g_hash_table_destroy (slots);
+    g_array_free (keys, TRUE);
+    g_array_free (counts, TRUE);
+    g_array_free (last, TRUE);
+
+    return ! g_atomic_int_get (cancel);
+}
+
+static void database_free (Database * db)
+{
+    g_free (db->strings);
+    g_free (db->items);
+    g_free (db->matches);
+    g_free (db->entry_items);
+    g_free (db->trigrams);
+    g_free (db->trigram_start);
+    g_free (db->trigram_ids);
+    g_slice_free (Database, db);
+}
+
+/* runs in a worker thread; returns NULL if cancelled */
+static Database * build_database (int list_id, volatile int * cancel)
+{
+    /* the playlist functions are thread-safe */
+    int list = aud_playlist_by_unique_id (list_id);
+    if (list < 0)
+        return NULL;
+
+    /* identical pooled strings have the same pointer */
+    GHashTable * artists = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+     NULL, (GDestroyNotify) node_free);
 
     int entries = aud_playlist_entry_count (list);
+    Node * * entry_nodes = g_new0 (Node *, entries);
 
     for (int e = 0; e < entries; e ++)
     {
+        if (! (e & 1023) && g_atomic_int_get (cancel))
+            break;
+
         char * title, * artist, * album;
-        Item * artist_item, * album_item, * title_item;
 
-        aud_playlist_entry_describe (list, e, & title, & artist, & album, TRUE);
+        if (! describe_entry (list, e, & title, & artist, & album))
+            continue;
+
+        Node * artist_node = get_child (artists, artist, NULL, FALSE);
+        g_array_append_val (artist_node->matches, e);
+
+        Node * album_node = get_child (artist_node->children, album,
+         artist_node, FALSE);
+        g_array_append_val (album_node->matches, e);
+
+        Node * title_node = get_child (album_node->children, title, album_node,
+         TRUE);
+        g_array_append_val (title_node->matches, e);
+
+        entry_nodes[e] = title_node;
+    }
+
+    if (g_atomic_int_get (cancel))
+    {
+        g_hash_table_destroy (artists);
+        g_free (entry_nodes);
+        return NULL;
+    }
+
+    /* number the nodes breadth-first, so that children are contiguous */
+    GPtrArray * order = g_ptr_array_new ();
+    g_hash_table_foreach (artists, append_node_cb, order);
+    int n_artists = order->len;
 
-        if (! title)
+    for (int i = 0; i < order->len; i ++)
+    {
+        if (! (i & 1023) && g_atomic_int_get (cancel))
+            break;
+
+        Node * node = g_ptr_array_index (order, i);
+
+        node->children_start = order->len;
+        if (node->children)
+            g_hash_table_foreach (node->children, append_node_cb, order);
+        node->n_children = order->len - node->children_start;
+    }
+
+    if (g_atomic_int_get (cancel))
+    {
+        g_ptr_array_free (order, TRUE);
+        g_hash_table_destroy (artists);
+        g_free (entry_nodes);
+        return NULL;
+    }
+
+    Database * db = g_slice_new0 (Database);
+    db->n_items = order->len;
+    db->n_artists = n_artists;
+    db->items = g_new (Item, db->n_items);
+    db->n_entries = entries;
+    db->entry_items = g_new (int, entries);
+
+    /* names are shared between items, e.g. "Unknown Album" */
+    GHashTable * offsets = g_hash_table_new (g_direct_hash, g_direct_equal);
+    GString * strings = g_string_new (NULL);
+
+    for (int i = 0; i < db->n_items; i ++)
+    {
+        if (! (i & 1023) && g_atomic_int_get (cancel))
+            break;
+
+        Node * node = g_ptr_array_index (order, i);
+        Item * item = & db->items[i];
+        void * offset;
+
+        if (! g_hash_table_lookup_extended (offsets, node->name, NULL, & offset))
         {
-            str_unref (artist);
-            str_unref (album);
-            continue;
+            offset = GINT_TO_POINTER (strings->len);
+            g_hash_table_insert (offsets, node->name, offset);
+
+            char * folded = g_utf8_casefold (node->name, -1);
+            g_string_append_len (strings, node->name, strlen (node->name) + 1);
+            g_string_append_len (strings, folded, strlen (folded) + 1);
+            g_free (folded);
         }
 
-        if (! artist)
-            artist = str_get (_("Unknown Artist"));
-        if (! album)
-            album = str_get (_("Unknown Album"));
+        item->field = (i < n_artists) ? ARTIST : node->parent->parent ? TITLE : ALBUM;
+        item->name = GPOINTER_TO_INT (offset);
+        item->folded = item->name + strlen (node->name) + 1;
+        item->parent = node->parent ? node->parent->id : -1;
+        item->children = node->children_start;
+        item->n_children = node->n_children;
+        item->matches = db->n_matches;
+        item->n_matches = node->matches->len;
+
+        db->n_matches += node->matches->len;
+    }
+
+    if (g_atomic_int_get (cancel))
+    {
+        g_hash_table_destroy (offsets);
+        g_string_free (strings, TRUE);
+        g_ptr_array_free (order, TRUE);
+        g_hash_table_destroy (artists);
+        g_free (entry_nodes);
+        database_free (db);
+        return NULL;
+    }
+
+    db->matches = g_new (int, db->n_matches);
+
+    for (int i = 0; i < db->n_items; i ++)
+    {
+        Node * node = g_ptr_array_index (order, i);
+        memcpy (db->matches + db->items[i].matches, node->matches->data,
+         sizeof (int) * node->matches->len);
+    }
+
+    for (int e = 0; e < entries; e ++)
+        db->entry_items[e] = entry_nodes[e] ? entry_nodes[e]->id : -1;
+
+    db->strings_size = strings->len;
+    db->strings = g_string_free (strings, FALSE);
+
+    g_hash_table_destroy (offsets);
+    g_ptr_array_free (order, TRUE);
+    g_hash_table_destroy (artists);
+    g_free (entry_nodes);
+
+    if (! index_trigrams (db, cancel))
+    {
+        database_free (db);
+        return NULL;
+    }
+
+    AUDDBG ("Search database: %d items, %d entries, %d trigrams.\n",
+     db->n_items, db->n_entries, db->n_trigrams);
+    AUDDBG ("Memory used: %d kB strings, %d kB items, %d kB matches, "
+     "%d kB trigram index.\n", db->strings_size / 1024, (int) (sizeof (Item) *
+     db->n_items + sizeof (int) * db->n_entries) / 1024, (int) (sizeof (int) *
+     db->n_matches) / 1024, (int) (sizeof (unsigned) * db->n_trigrams +
+     sizeof (int) * (db->n_trigrams + 1 + db->trigram_start[db->n_trigrams]))
+     / 1024);
+
+    return db;
+}
+
+static void build_job_free (BuildJob * job)
+{
+    if (job->database)
+        database_free (job->database);
+
+    g_free (job);
+}
+
+static int build_ready (void * _job)
+{
+    BuildJob * job = _job;
+
+    /* the worker has finished, so the join does not block */
+    g_thread_join (job->thread);
+
+    /* the result of a cancelled build is discarded */
+    if (job != build_job)
+    {
+        stale_jobs = g_slist_remove (stale_jobs, job);
+        build_job_free (job);
+        return FALSE;
+    }
+
+    Database * db = job->database;
+    g_free (job);
+    build_job = NULL;
+
+    if (db)
+    {
+        destroy_database ();
+        database = db;
+        schedule_search ();
+    }
+
+    show_hide_widgets ();
+    return FALSE;
+}
+
+static void * build_thread (void * _job)
+{
+    BuildJob * job = _job;
+    job->database = build_database (job->list_id, & job->cancel);
+    g_idle_add (build_ready, job);
+    return NULL;
+}
+
+/* The worker is not waited for; build_ready() cleans up after it. */
+static void cancel_build (void)
+{
+    if (! build_job)
+        return;
+
+    g_atomic_int_set (& build_job->cancel, TRUE);
+    stale_jobs = g_slist_prepend (stale_jobs, build_job);
+    build_job = NULL;
+}
+
+/* Waits for all workers, before the plugin is unloaded. */
+static void finish_builds (void)
+{
+    cancel_build ();
+
+    while (stale_jobs)
+    {
+        BuildJob * job = stale_jobs->data;
+        stale_jobs = g_slist_delete_link (stale_jobs, stale_jobs);
+
+        g_thread_join (job->thread);
+
+        /* the worker may already have scheduled build_ready() */
+        g_source_remove_by_user_data (job);
+        build_job_free (job);
+    }
+}
+
+/* The current database (if any) stays in use until the new one is ready. */
+static void start_build (void)
+{
+    cancel_build ();
+
+    build_job = g_new0 (BuildJob, 1);
+    build_job->list_id = playlist_id;
+    build_job->thread = g_thread_create (build_thread, build_job, TRUE, NULL);
+
+    if (! build_job->thread)
+    {
+        g_free (build_job);
+        build_job = NULL;
+    }
+}
+
+static void destroy_database (void)
+{
+    if (term_cache)
+        g_hash_table_remove_all (term_cache);
 
-        artist_item = g_hash_table_lookup (database, artist);
+    /* the results refer to the database */
+    if (items)
+        index_delete (items, 0, index_count (items));
+    if (results_list)
+        audgui_list_delete_rows (results_list, 0, audgui_list_row_count
+         (results_list));
 
-        if (! artist_item)
+    if (database)
+    {
+        database_free (database);
+        database = NULL;
+    }
+}
+
+/* Checks whether metadata in the given range of entries has changed since the
+ * database was built. */
+static bool_t entries_changed (int list, int at, int count)
+{
+    if (aud_playlist_entry_count (list) != database->n_entries)
+        return TRUE;
+
+    for (int e = at; e < at + count; e ++)
+    {
+        char * title, * artist, * album;
+        int id = database->entry_items[e];
+
+        if (! describe_entry (list, e, & title, & artist, & album))
         {
-            /* item_new() takes ownership of reference to artist */
-            artist_item = item_new (ARTIST, artist, NULL);
-            g_hash_table_insert (database, artist, artist_item);
-        }
-        else
-            str_unref (artist);
+            if (id >= 0)
+                return TRUE;
 
-        g_array_append_val (artist_item->matches, e);
+            continue;
+        }
 
-        album_item = g_hash_table_lookup (artist_item->children, album);
+        bool_t same = FALSE;
 
-        if (! album_item)
+        if (id >= 0)
         {
-            /* item_new() takes ownership of reference to album */
-            album_item = item_new (ALBUM, album, artist_item);
-            g_hash_table_insert (artist_item->children, album, album_item);
+            Item * title_item = ITEM (id);
+            Item * album_item = ITEM (title_item->parent);
+            Item * artist_item = ITEM (album_item->parent);
+
+            same = ! strcmp (title, ITEM_NAME (title_item)) && ! strcmp
+             (album, ITEM_NAME (album_item)) && ! strcmp (artist, ITEM_NAME
+             (artist_item));
         }
-        else
-            str_unref (album);
 
-        g_array_append_val (album_item->matches, e);
+        str_unref (title);
+        str_unref (artist);
+        str_unref (album);
+
+        if (! same)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+static bool_t find_trigram (unsigned key, const int * * ids, int * n)
+{
+    int low = 0, high = database->n_trigrams;
 
-        title_item = g_hash_table_lookup (album_item->children, title);
+    while (low < high)
+    {
+        int mid = (low + high) / 2;
 
-        if (! title_item)
+        if (database->trigrams[mid] == key)
         {
-            /* item_new() takes ownership of reference to title */
-            title_item = item_new (TITLE, title, album_item);
-            g_hash_table_insert (album_item->children, title, title_item);
+            * ids = database->trigram_ids + database->trigram_start[mid];
+            * n = database->trigram_start[mid + 1] - database->trigram_start[mid];
+            return TRUE;
         }
-        else
-            str_unref (title);
 
-        g_array_append_val (title_item->matches, e);
+        if (database->trigrams[mid] < key)
+            low = mid + 1;
+        else
+            high = mid;
     }
+
+    return FALSE;
 }
 
-static void search_cb (void * key, void * _item, void * _state)
+/* Returns the ids of all items whose folded name contains <term>.  A cached
+ * result for a shorter term contained in this one (typically the previous
+ * keystroke) narrows the candidates; otherwise the trigram index does. */
+static GArray * find_term (const char * term)
 {
-    Item * item = _item;
-    SearchState * state = _state;
+    GArray * found = g_hash_table_lookup (term_cache, term);
+    if (found)
+        return found;
 
-    if (index_count (state->items[item->field]) > MAX_RESULTS)
-        return;
+    const int * candidates = NULL;
+    int n_candidates = database->n_items;
+    bool_t none = FALSE;
 
-    int oldmask = state->mask;
+    GHashTableIter iter;
+    void * key, * value;
 
-    for (int t = 0, bit = 1; search_terms[t]; t ++, bit <<= 1)
+    g_hash_table_iter_init (& iter, term_cache);
+    while (g_hash_table_iter_next (& iter, & key, & value))
     {
-        if (! (state->mask & bit))
-            continue; /* skip term if it is already found */
+        GArray * ids = value;
 
-        if (strstr (item->folded, search_terms[t]))
-            state->mask &= ~bit; /* we found it */
-        else if (! item->children)
-            break; /* quit early if there are no children to search */
+        if (strstr (term, key) && (! candidates || (int) ids->len <
+         n_candidates))
+        {
+            candidates = (const int *) ids->data;
+            n_candidates = ids->len;
+        }
+    }
+
+    if (! candidates)
+    {
+        int len = strlen (term);
+
+        for (int i = 0; i + 3 <= len; i ++)
+        {
+            const int * ids;
+            int n;
+
+            if (! find_trigram (TRIGRAM (term + i), & ids, & n))
+            {
+                none = TRUE;
+                break;
+            }
+
+            if (! candidates || n < n_candidates)
+            {
+                candidates = ids;
+                n_candidates = n;
+            }
+        }
     }
 
-    if (! state->mask)
-        index_append (state->items[item->field], item);
+    found = g_array_new (FALSE, FALSE, sizeof (int));
 
-    if (item->children)
-        g_hash_table_foreach (item->children, search_cb, state);
+    for (int i = 0; i < n_candidates && ! none; i ++)
+    {
+        int id = candidates ? candidates[i] : i;
 
-    state->mask = oldmask;
+        if (strstr (ITEM_FOLDED (ITEM (id)), term))
+            g_array_append_val (found, id);
+    }
+
+    g_hash_table_insert (term_cache, g_strdup (term), found);
+    return found;
+}
+
+/* An item matches if each search term is found in its name or in the name of
+ * one of its parents.  The pivot term holds for the whole subtree searched. */
+static bool_t item_matches (int id, SearchState * state)
+{
+    for (int t = 0; t < state->n_sets; t ++)
+    {
+        if (t == state->pivot)
+            continue;
+
+        int i = id;
+        while (i >= 0 && ! has_id (state->sets[t], i))
+            i = ITEM (i)->parent;
+
+        if (i < 0)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void search_item (int id, SearchState * state)
+{
+    if (state->full == FIELDS)
+        return; /* nothing more can be shown */
+
+    Item * item = ITEM (id);
+    Index * found = state->items[item->field];
+
+    if (index_count (found) <= MAX_RESULTS && item_matches (id, state))
+    {
+        index_append (found, item);
+        if (index_count (found) > MAX_RESULTS)
+            state->full ++;
+    }
+
+    for (int c = 0; c < item->n_children; c ++)
+        search_item (item->children + c, state);
 }
 
 static int item_compare (const void * _a, const void * _b)
 {
     const Item * a = _a, * b = _b;
-    return string_compare (a->name, b->name);
+    return string_compare (ITEM_NAME (a), ITEM_NAME (b));
+}
+
+static bool_t is_search_term (const char * term)
+{
+    for (int t = 0; search_terms[t]; t ++)
+    {
+        if (! strcmp (search_terms[t], term))
+            return TRUE;
+    }
+
+    return FALSE;
 }
 
 static void do_search (void)
@@ -311,12 +890,59 @@ static void do_search (void)
     for (int f = 0; f < FIELDS; f ++)
         state.items[f] = index_new ();
 
+    state.full = 0;
+    state.n_sets = 0;
+    state.pivot = -1;
+
     /* effectively limits number of search terms to 32 */
-    state.mask = 0;
-    for (int t = 0, bit = 1; search_terms[t]; t ++, bit <<= 1)
-        state.mask |= bit;
+    for (int t = 0; search_terms[t] && state.n_sets < 32; t ++)
+    {
+        if (! search_terms[t][0])
+            continue;
+
+        GArray * set = find_term (search_terms[t]);
+
+        if (state.pivot < 0 || set->len < state.sets[state.pivot]->len)
+            state.pivot = state.n_sets;
+
+        state.sets[state.n_sets ++] = set;
+    }
+
+    /* drop cached results of terms no longer typed, only now so that the
+     * results of shorter terms could still be narrowed down above */
+    GHashTableIter iter;
+    void * key;
+
+    g_hash_table_iter_init (& iter, term_cache);
+    while (g_hash_table_iter_next (& iter, & key, NULL))
+    {
+        if (! is_search_term (key))
+            g_hash_table_iter_remove (& iter);
+    }
+
+    if (state.pivot < 0)
+    {
+        for (int id = 0; id < database->n_artists; id ++)
+            search_item (id, & state);
+    }
+    else
+    {
+        /* search the subtrees below the items matching the rarest term,
+         * skipping items already covered by a matching parent */
+        GArray * pivot = state.sets[state.pivot];
+
+        for (int i = 0; i < pivot->len; i ++)
+        {
+            int id = g_array_index (pivot, int, i);
+            int parent = ITEM (id)->parent;
+
+            while (parent >= 0 && ! has_id (pivot, parent))
+                parent = ITEM (parent)->parent;
 
-    g_hash_table_foreach (database, search_cb, & state);
+            if (parent < 0)
+                search_item (id, & state);
+        }
+    }
 
     for (int f = 0; f < FIELDS; f ++)
     {
@@ -447,19 +1073,13 @@ static void schedule_search (void)
 
 static void update_database (void)
 {
-    int list = get_playlist (TRUE, TRUE);
-
-    if (list >= 0)
-    {
-        create_database (list);
-        schedule_search ();
-    }
+    if (get_playlist (TRUE, TRUE) >= 0)
+        start_build ();
     else
-        destroy_database ();
-
-    if (results_list)
-        audgui_list_delete_rows (results_list, 0, audgui_list_row_count (results_list));
+        cancel_build ();
 
+    /* entries may have moved, so the old database cannot be used meanwhile */
+    destroy_database ();
     show_hide_widgets ();
 }
 
@@ -477,28 +1097,32 @@ static void add_complete_cb (void * unused, void * unused2)
         }
     }
 
-    if (! database && ! aud_playlist_update_pending ())
+    if (! database && ! build_job && ! aud_playlist_update_pending ())
         update_database ();
 }
 
 static void scan_complete_cb (void * unused, void * unused2)
 {
-    if (! database && ! aud_playlist_update_pending ())
+    if (! database && ! build_job && ! aud_playlist_update_pending ())
         update_database ();
 }
 
 static void playlist_update_cb (void * data, void * unused)
 {
-    if (! database)
+    int list = get_playlist (TRUE, TRUE);
+    int at = 0, count = 0;
+    int level = (list < 0) ? 0 : aud_playlist_updated_range (list, & at,
+     & count);
+
+    if (list < 0 || level >= PLAYLIST_UPDATE_STRUCTURE || (! database &&
+     (level >= PLAYLIST_UPDATE_METADATA || ! build_job)))
         update_database ();
-    else
+    else if (level >= PLAYLIST_UPDATE_METADATA && (build_job || entries_changed
+     (list, at, count)))
     {
-        int list = get_playlist (TRUE, TRUE);
-        int at, count;
-
-        if (list < 0 || aud_playlist_updated_range (list, & at, & count) >=
-         PLAYLIST_UPDATE_METADATA)
-            update_database ();
+        /* entries have not moved, so keep searching the old database until
+         * the new one is ready */
+        start_build ();
     }
 }
 
@@ -507,6 +1131,8 @@ static bool_t search_init (void)
     find_playlist ();
 
     set_search_phrase ("");
+    term_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+     id_array_free);
     items = index_new ();
     selection = g_array_new (FALSE, FALSE, 1);
 
@@ -540,7 +1166,11 @@ static void search_cleanup (void)
     selection = NULL;
 
     destroy_added_table ();
+    finish_builds ();
     destroy_database ();
+
+    g_hash_table_destroy (term_cache);
+    term_cache = NULL;
 }
 
 static void do_add (bool_t play, char * * title)
@@ -559,16 +1189,16 @@ static void do_add (bool_t play, char * * title)
 
         Item * item = index_get (items, i);
 
-        for (int m = 0; m < item->matches->len; m ++)
+        for (int m = 0; m < item->n_matches; m ++)
         {
-            int entry = g_array_index (item->matches, int, m);
+            int entry = database->matches[item->matches + m];
             index_append (filenames, aud_playlist_entry_get_filename (list, entry));
             index_append (tuples, aud_playlist_entry_get_tuple (list, entry, TRUE));
         }
 
         n_selected ++;
         if (title && n_selected == 1)
-            * title = item->name;
+            * title = ITEM_NAME (item);
     }
 
     if (title && n_selected != 1)
@@ -624,23 +1254,24 @@ static void list_get_value (void * user, int row, int column, GValue * value)
         char scratch[128];
 
     case TITLE:
-        string = g_strdup_printf (_("%s\n on %s by %s"), item->name,
-         item->parent->name, item->parent->parent->name);
+        string = g_strdup_printf (_("%s\n on %s by %s"), ITEM_NAME (item),
+         ITEM_NAME (ITEM (item->parent)), ITEM_NAME (ITEM (ITEM
+         (item->parent)->parent)));
         break;
 
     case ARTIST:
-        albums = g_hash_table_size (item->children);
+        albums = item->n_children;
         snprintf (scratch, sizeof scratch, dngettext (PACKAGE, "%d album",
          "%d albums", albums), albums);
         string = g_strdup_printf (dngettext (PACKAGE, "%s\n %s, %d song",
-         "%s\n %s, %d songs", item->matches->len), item->name, scratch,
-         item->matches->len);
+         "%s\n %s, %d songs", item->n_matches), ITEM_NAME (item), scratch,
+         item->n_matches);
         break;
 
     case ALBUM:
         string = g_strdup_printf (dngettext (PACKAGE, "%s\n %d song by %s",
-         "%s\n %d songs by %s", item->matches->len), item->name,
-         item->matches->len, item->parent->name);
+         "%s\n %d songs by %s", item->n_matches), ITEM_NAME (item),
+         item->n_matches, ITEM_NAME (ITEM (item->parent)));
         break;
     }
 
@@ -26,6 +26,23 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+
+
+/* Cache of computed tune hashes, keyed by filename
+ */
+typedef struct {
+    gint64          mtime;
+    xs_md5hash_t    md5Hash;
+} xs_sldb_hash_t;
+
+static GHashTable *xs_sldb_hashes = NULL;
+XS_MUTEX(xs_sldb_hashes);
 
 
 /* Free memory allocated for given SLDB node
@@ -197,6 +214,7 @@ gint xs_sldb_read(xs_sldb_t *db, const gchar *dbFilename)
     gchar inLine[XS_BUF_SIZE];
     size_t lineNum;
     sldb_node_t *tmnode;
+    struct stat st;
     assert(db);
 
     /* Try to open the file */
@@ -205,6 +223,12 @@ gint xs_sldb_read(xs_sldb_t *db, const gchar *dbFilename)
         return -1;
     }
 
+    /* Remember what the index is built from */
+    if (fstat(fileno(inFile), &st) == 0) {
+        db->srcMTime = st.st_mtime;
+        db->srcSize = st.st_size;
+    }
+
     /* Read and parse the data */
     lineNum = 0;
 
@@ -274,12 +298,51 @@ static gint xs_sldb_cmp(const void *node1, const void *node2)
 }
 
 
-/* (Re)create index
+/* Point the database at a compiled index image
+ */
+static void xs_sldb_set_image(xs_sldb_t *db, guint8 *image, size_t size, gboolean mapped)
+{
+    const xs_sldb_index_header_t *header = (const xs_sldb_index_header_t *) image;
+
+    db->image = image;
+    db->imageSize = size;
+    db->imageMapped = mapped;
+    db->n = header->nentries;
+    db->entries = (const xs_sldb_index_entry_t *) (image + sizeof(xs_sldb_index_header_t));
+    db->lengths = (const guint32 *) (db->entries + header->nentries);
+}
+
+
+/* Free the parsed node list, it is not needed once the index is built
+ */
+static void xs_sldb_free_nodes(xs_sldb_t *db)
+{
+    sldb_node_t *pCurr, *next;
+
+    pCurr = db->nodes;
+    while (pCurr) {
+        next = pCurr->next;
+        xs_sldb_node_free(pCurr);
+        pCurr = next;
+    }
+
+    db->nodes = NULL;
+
+    g_free(db->pindex);
+    db->pindex = NULL;
+}
+
+
+/* (Re)create index, compiling the parsed nodes to a sorted index image
  */
 gint xs_sldb_index(xs_sldb_t * db)
 {
     sldb_node_t *pCurr;
-    size_t i;
+    xs_sldb_index_header_t *header;
+    xs_sldb_index_entry_t *entries;
+    guint32 *lengths, nlengths;
+    guint8 *image;
+    size_t i, n, size;
     assert(db);
 
     /* Free old index */
@@ -290,29 +353,142 @@ gint xs_sldb_index(xs_sldb_t * db)
 
     /* Get size of db */
     pCurr = db->nodes;
-    db->n = 0;
+    n = 0;
+    nlengths = 0;
     while (pCurr) {
-        db->n++;
+        n++;
+        nlengths += pCurr->nlengths;
         pCurr = pCurr->next;
     }
 
     /* Check number of nodes */
-    if (db->n > 0) {
+    if (n > 0) {
         /* Allocate memory for index-table */
-        db->pindex = (sldb_node_t **) g_malloc(sizeof(sldb_node_t *) * db->n);
+        db->pindex = (sldb_node_t **) g_malloc(sizeof(sldb_node_t *) * n);
         if (!db->pindex)
             return -1;
 
         /* Get node-pointers to table */
         i = 0;
         pCurr = db->nodes;
-        while (pCurr && (i < db->n)) {
+        while (pCurr && (i < n)) {
             db->pindex[i++] = pCurr;
             pCurr = pCurr->next;
         }
 
         /* Sort the indexes */
-        qsort(db->pindex, db->n, sizeof(sldb_node_t *), xs_sldb_cmp);
+        qsort(db->pindex, n, sizeof(sldb_node_t *), xs_sldb_cmp);
+    }
+
+    /* Compile the index image */
+    size = sizeof(xs_sldb_index_header_t) +
+        n * sizeof(xs_sldb_index_entry_t) + nlengths * sizeof(guint32);
+
+    image = (guint8 *) g_malloc0(size);
+    if (!image)
+        return -1;
+
+    header = (xs_sldb_index_header_t *) image;
+    memcpy(header->magic, XS_SLDB_INDEX_MAGIC, sizeof(header->magic));
+    header->version = XS_SLDB_INDEX_VERSION;
+    header->srcMTime = db->srcMTime;
+    header->srcSize = db->srcSize;
+    header->nentries = n;
+    header->nlengths = nlengths;
+
+    entries = (xs_sldb_index_entry_t *) (image + sizeof(xs_sldb_index_header_t));
+    lengths = (guint32 *) (entries + n);
+
+    for (i = 0, nlengths = 0; i < n; i++) {
+        gint j;
+
+        memcpy(entries[i].md5Hash, db->pindex[i]->md5Hash, sizeof(xs_md5hash_t));
+        entries[i].offset = nlengths;
+        entries[i].nlengths = db->pindex[i]->nlengths;
+
+        for (j = 0; j < db->pindex[i]->nlengths; j++)
+            lengths[nlengths++] = db->pindex[i]->lengths[j];
+    }
+
+    xs_sldb_free_nodes(db);
+    xs_sldb_set_image(db, image, size, FALSE);
+
+    return 0;
+}
+
+
+/* Map a compiled index from disk, if it is valid and up to date
+ * with the given SongLengthDB file
+ */
+gint xs_sldb_map_index(xs_sldb_t *db, const gchar *indexFilename, const gchar *dbFilename)
+{
+    const xs_sldb_index_header_t *header;
+    const xs_sldb_index_entry_t *entries;
+    struct stat st, ist;
+    guint8 *image;
+    size_t i;
+    gint fd;
+    assert(db);
+
+    if (g_stat(dbFilename, &st) != 0)
+        return -1;
+
+    if ((fd = g_open(indexFilename, O_RDONLY, 0)) < 0)
+        return -1;
+
+    if (fstat(fd, &ist) != 0 || ist.st_size < (off_t) sizeof(xs_sldb_index_header_t)) {
+        close(fd);
+        return -2;
+    }
+
+    image = mmap(NULL, ist.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (image == MAP_FAILED)
+        return -2;
+
+    /* Check header, size and entries */
+    header = (const xs_sldb_index_header_t *) image;
+    if (memcmp(header->magic, XS_SLDB_INDEX_MAGIC, sizeof(header->magic)) ||
+        header->version != XS_SLDB_INDEX_VERSION ||
+        header->srcMTime != (gint64) st.st_mtime ||
+        header->srcSize != (gint64) st.st_size ||
+        (size_t) ist.st_size != sizeof(xs_sldb_index_header_t) +
+            (size_t) header->nentries * sizeof(xs_sldb_index_entry_t) +
+            (size_t) header->nlengths * sizeof(guint32))
+        goto invalid;
+
+    entries = (const xs_sldb_index_entry_t *) (image + sizeof(xs_sldb_index_header_t));
+    for (i = 0; i < header->nentries; i++) {
+        if (entries[i].offset > header->nlengths ||
+            entries[i].nlengths > header->nlengths - entries[i].offset)
+            goto invalid;
+    }
+
+    xs_sldb_free_nodes(db);
+    xs_sldb_set_image(db, image, ist.st_size, TRUE);
+    return 0;
+
+invalid:
+    munmap(image, ist.st_size);
+    return -3;
+}
+
+
+/* Save the compiled index to disk, to be mapped on later starts
+ */
+gint xs_sldb_write_index(xs_sldb_t *db, const gchar *indexFilename)
+{
+    GError *error = NULL;
+    assert(db);
+
+    if (!db->image)
+        return -1;
+
+    if (!g_file_set_contents(indexFilename, (const gchar *) db->image, db->imageSize, &error)) {
+        xs_error("Could not write SongLengthDB index '%s': %s\n", indexFilename, error->message);
+        g_error_free(error);
+        return -2;
     }
 
     return 0;
@@ -323,25 +499,18 @@ gint xs_sldb_index(xs_sldb_t * db)
  */
 void xs_sldb_free(xs_sldb_t * db)
 {
-    sldb_node_t *pCurr, *next;
-
     if (!db)
         return;
 
-    /* Free the memory allocated for nodes */
-    pCurr = db->nodes;
-    while (pCurr) {
-        next = pCurr->next;
-        xs_sldb_node_free(pCurr);
-        pCurr = next;
-    }
-
-    db->nodes = NULL;
+    /* Free the memory allocated for nodes and index */
+    xs_sldb_free_nodes(db);
 
-    /* Free memory allocated for index */
-    if (db->pindex) {
-        g_free(db->pindex);
-        db->pindex = NULL;
+    if (db->image) {
+        if (db->imageMapped)
+            munmap(db->image, db->imageSize);
+        else
+            g_free(db->image);
+        db->image = NULL;
     }
 
     /* Free structure */
@@ -494,28 +663,110 @@ static gint xs_get_sid_hash(const gchar *filename, xs_md5hash_t hash)
 }
 
 
-/* Get node from db index via binary search
+/* Get the hash of given SID-file, from the cache if the file has not
+ * changed since the hash was computed
  */
-sldb_node_t *xs_sldb_get(xs_sldb_t *db, const gchar *filename)
+static gint xs_get_sid_hash_cached(const gchar *filename, xs_md5hash_t hash)
 {
-    sldb_node_t keyItem, *key, **item;
+    xs_sldb_hash_t *item;
+    gchar *path;
+    struct stat st;
+    gboolean cacheable;
+    gint result;
+
+    /* Only local files can be checked for modifications */
+    if ((path = g_filename_from_uri(filename, NULL, NULL)) == NULL)
+        path = g_strdup(filename);
+
+    cacheable = (g_stat(path, &st) == 0);
+    g_free(path);
+
+    if (cacheable) {
+        XS_MUTEX_LOCK(xs_sldb_hashes);
+
+        if (xs_sldb_hashes &&
+            (item = g_hash_table_lookup(xs_sldb_hashes, filename)) != NULL &&
+            item->mtime == (gint64) st.st_mtime) {
+            memcpy(hash, item->md5Hash, sizeof(xs_md5hash_t));
+            XS_MUTEX_UNLOCK(xs_sldb_hashes);
+            return 0;
+        }
+
+        XS_MUTEX_UNLOCK(xs_sldb_hashes);
+    }
+
+    if ((result = xs_get_sid_hash(filename, hash)) != 0 || !cacheable)
+        return result;
+
+    item = g_new(xs_sldb_hash_t, 1);
+    item->mtime = st.st_mtime;
+    memcpy(item->md5Hash, hash, sizeof(xs_md5hash_t));
+
+    XS_MUTEX_LOCK(xs_sldb_hashes);
+
+    if (!xs_sldb_hashes)
+        xs_sldb_hashes = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+    g_hash_table_replace(xs_sldb_hashes, g_strdup(filename), item);
+
+    XS_MUTEX_UNLOCK(xs_sldb_hashes);
+
+    return 0;
+}
+
+
+/* Free the cache of tune hashes
+ */
+void xs_sldb_hash_cache_free(void)
+{
+    XS_MUTEX_LOCK(xs_sldb_hashes);
+
+    if (xs_sldb_hashes) {
+        g_hash_table_destroy(xs_sldb_hashes);
+        xs_sldb_hashes = NULL;
+    }
+
+    XS_MUTEX_UNLOCK(xs_sldb_hashes);
+}
+
+
+/* Compare a hash with an index entry
+ */
+static gint xs_sldb_cmpentry(const void *hash, const void *entry)
+{
+    return memcmp(hash, ((const xs_sldb_index_entry_t *) entry)->md5Hash,
+        sizeof(xs_md5hash_t));
+}
+
+
+/* Get lengths of given file from db index via binary search.
+ * Returns the number of lengths, copied to a newly allocated array.
+ */
+gint xs_sldb_get(xs_sldb_t *db, const gchar *filename, gint **lengths)
+{
+    const xs_sldb_index_entry_t *item;
+    xs_md5hash_t hash;
+    guint32 i;
+
+    *lengths = NULL;
 
     /* Check the database pointers */
-    if (!db || !db->nodes || !db->pindex)
-        return NULL;
+    if (!db || !db->entries)
+        return 0;
 
     /* Get the hash and then look up from db */
-    if (xs_get_sid_hash(filename, keyItem.md5Hash) == 0) {
-        key = &keyItem;
-        item = bsearch(&key, db->pindex, db->n,
-            sizeof(db->pindex[0]), xs_sldb_cmp);
+    if (xs_get_sid_hash_cached(filename, hash) != 0)
+        return 0;
 
-        if (item)
-            return *item;
-        else
-            return NULL;
-    } else
-        return NULL;
-}
+    item = bsearch(hash, db->entries, db->n,
+        sizeof(db->entries[0]), xs_sldb_cmpentry);
+
+    if (!item || !item->nlengths)
+        return 0;
 
+    *lengths = g_new(gint, item->nlengths);
+    for (i = 0; i < item->nlengths; i++)
+        (*lengths)[i] = db->lengths[item->offset + i];
 
+    return item->nlengths;
+}
@@ -18,10 +18,41 @@ typedef struct _sldb_node_t {
 } sldb_node_t;
 
 
+/* Compiled index, as stored on disk: header, entries sorted
+ * by hash, then the lengths of all entries.
+ */
+#define XS_SLDB_INDEX_MAGIC     "XSLI"
+#define XS_SLDB_INDEX_VERSION   (1)
+
+typedef struct {
+    gchar           magic[4];   /* XS_SLDB_INDEX_MAGIC */
+    guint32         version;    /* XS_SLDB_INDEX_VERSION */
+    gint64          srcMTime,   /* Modification time and size of the */
+                    srcSize;    /* Songlengths.txt the index was built from */
+    guint32         nentries,   /* Number of entries */
+                    nlengths;   /* Total number of lengths */
+} xs_sldb_index_header_t;
+
+
 typedef struct {
-    sldb_node_t     *nodes,
+    xs_md5hash_t    md5Hash;    /* 128-bit MD5 hash-digest */
+    guint32         offset,     /* Index of first length */
+                    nlengths;   /* Number of lengths */
+} xs_sldb_index_entry_t;
+
+
+typedef struct {
+    sldb_node_t     *nodes,     /* Parsed entries, until the index is built */
                     **pindex;
     size_t          n;
+
+    gint64          srcMTime, srcSize;
+
+    guint8          *image;     /* Compiled index, mmap()ed or in memory */
+    size_t          imageSize;
+    gboolean        imageMapped;
+    const xs_sldb_index_entry_t *entries;
+    const guint32   *lengths;
 } xs_sldb_t;
 
 
@@ -29,8 +60,11 @@ typedef struct {
  */
 gint            xs_sldb_read(xs_sldb_t *, const gchar *);
 gint            xs_sldb_index(xs_sldb_t *);
+gint            xs_sldb_map_index(xs_sldb_t *, const gchar *, const gchar *);
+gint            xs_sldb_write_index(xs_sldb_t *, const gchar *);
 void            xs_sldb_free(xs_sldb_t *);
-sldb_node_t *   xs_sldb_get(xs_sldb_t *, const gchar *);
+gint            xs_sldb_get(xs_sldb_t *, const gchar *, gint **);
+void            xs_sldb_hash_cache_free(void);
 
 #ifdef __cplusplus
 }
@@ -23,6 +23,10 @@
 #include "xs_slsup.h"
 #include "xs_config.h"
 
+#ifdef AUDACIOUS_PLUGIN
+#include <audacious/misc.h>
+#endif
+
 
 static xs_sldb_t *xs_sldb_db = NULL;
 XS_MUTEX(xs_sldb_db);
@@ -126,8 +130,20 @@ stil_node_t *xs_stil_get(gchar *filename)
 
 /* Song length database handling glue
  */
+static gchar *xs_songlen_index_path(void)
+{
+#ifdef AUDACIOUS_PLUGIN
+    return g_build_filename(aud_get_path(AUD_PATH_USER_DIR), "sid-songlengths.idx", NULL);
+#else
+    return NULL;
+#endif
+}
+
+
 gint xs_songlen_init(void)
 {
+    gchar *indexPath;
+
     XS_MUTEX_LOCK(xs_cfg);
 
     if (!xs_cfg.songlenDBPath) {
@@ -149,10 +165,20 @@ gint xs_songlen_init(void)
         return -2;
     }
 
+    /* Use the compiled index, if it is up to date */
+    indexPath = xs_songlen_index_path();
+    if (indexPath && xs_sldb_map_index(xs_sldb_db, indexPath, xs_cfg.songlenDBPath) == 0) {
+        g_free(indexPath);
+        XS_MUTEX_UNLOCK(xs_cfg);
+        XS_MUTEX_UNLOCK(xs_sldb_db);
+        return 0;
+    }
+
     /* Read the database */
     if (xs_sldb_read(xs_sldb_db, xs_cfg.songlenDBPath) != 0) {
         xs_sldb_free(xs_sldb_db);
         xs_sldb_db = NULL;
+        g_free(indexPath);
         XS_MUTEX_UNLOCK(xs_cfg);
         XS_MUTEX_UNLOCK(xs_sldb_db);
         return -3;
@@ -162,11 +188,17 @@ gint xs_songlen_init(void)
     if (xs_sldb_index(xs_sldb_db) != 0) {
         xs_sldb_free(xs_sldb_db);
         xs_sldb_db = NULL;
+        g_free(indexPath);
         XS_MUTEX_UNLOCK(xs_cfg);
         XS_MUTEX_UNLOCK(xs_sldb_db);
         return -4;
     }
 
+    /* Save it for the next start; it is used from memory this time */
+    if (indexPath)
+        xs_sldb_write_index(xs_sldb_db, indexPath);
+
+    g_free(indexPath);
     XS_MUTEX_UNLOCK(xs_cfg);
     XS_MUTEX_UNLOCK(xs_sldb_db);
     return 0;
@@ -179,19 +211,26 @@ void xs_songlen_close(void)
     xs_sldb_free(xs_sldb_db);
     xs_sldb_db = NULL;
     XS_MUTEX_UNLOCK(xs_sldb_db);
+
+    xs_sldb_hash_cache_free();
 }
 
 
-sldb_node_t *xs_songlen_get(const gchar * filename)
+/* Get sub-tune lengths of given file; returns the number of lengths,
+ * which are stored in a newly allocated array
+ */
+gint xs_songlen_get(const gchar * filename, gint **lengths)
 {
-    sldb_node_t *result;
+    gint result;
 
     XS_MUTEX_LOCK(xs_sldb_db);
 
     if (xs_cfg.songlenDBEnable && xs_sldb_db)
-        result = xs_sldb_get(xs_sldb_db, filename);
-    else
-        result = NULL;
+        result = xs_sldb_get(xs_sldb_db, filename, lengths);
+    else {
+        *lengths = NULL;
+        result = 0;
+    }
 
     XS_MUTEX_UNLOCK(xs_sldb_db);
 
@@ -208,7 +247,7 @@ xs_tuneinfo_t *xs_tuneinfo_new(const gchar * filename,
         gint dataFileLen, const gchar *sidFormat, gint sidModel)
 {
     xs_tuneinfo_t *result;
-    sldb_node_t *tmpLength;
+    gint *tmpLengths, nlengths;
     gint i;
 
     /* Allocate structure */
@@ -254,18 +293,20 @@ xs_tuneinfo_t *xs_tuneinfo_new(const gchar * filename,
     
     result->sidModel = sidModel;
 
-    /* Get length information (NOTE: Do not free this!) */
-    tmpLength = xs_songlen_get(filename);
+    /* Get length information */
+    nlengths = xs_songlen_get(filename, &tmpLengths);
     
     /* Fill in sub-tune information */
     for (i = 0; i < result->nsubTunes; i++) {
-        if (tmpLength && (i < tmpLength->nlengths))
-            result->subTunes[i].tuneLength = tmpLength->lengths[i];
+        if (i < nlengths)
+            result->subTunes[i].tuneLength = tmpLengths[i];
         else
             result->subTunes[i].tuneLength = -1;
         
         result->subTunes[i].tuneSpeed = -1;
     }
+
+    g_free(tmpLengths);
     
     return result;
 }
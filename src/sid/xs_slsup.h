@@ -15,7 +15,7 @@ stil_node_t *xs_stil_get(gchar *filename);
 
 gint        xs_songlen_init(void);
 void        xs_songlen_close(void);
-sldb_node_t *xs_songlen_get(const gchar *);
+gint        xs_songlen_get(const gchar *, gint **);
 
 xs_tuneinfo_t *xs_tuneinfo_new(const gchar * pcFilename,
             gint nsubTunes, gint startTune, const gchar * sidName,
@@ -62,7 +62,6 @@ AUD_IFACE_PLUGIN
 
 static gboolean plugin_is_active = FALSE;
 
-static gint update_source;
 static GtkWidget * error_win;
 
 static void skins_free_paths(void) {
@@ -94,12 +93,6 @@ static void skins_init_paths() {
     g_free(xdg_cache_home);
 }
 
-static gboolean update_cb (void * unused)
-{
-    mainwin_update_song_info ();
-    return TRUE;
-}
-
 static gboolean skins_init (void)
 {
     plugin_is_active = TRUE;
@@ -128,8 +121,6 @@ static gboolean skins_init (void)
 
     mainwin_show (config.player_visible);
 
-    update_source = g_timeout_add (250, update_cb, NULL);
-
     return TRUE;
 }
 
@@ -141,7 +132,6 @@ static void skins_cleanup (void)
 
         mainwin_unhook ();
         playlistwin_unhook ();
-        g_source_remove (update_source);
 
         skins_cfg_save();
 
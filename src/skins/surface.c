@@ -67,3 +67,29 @@ void surface_copy_rect (cairo_surface_t * a, gint ax, gint ay, gint w, gint h,
     cairo_fill (cr);
     cairo_destroy (cr);
 }
+
+/* Copies the image surface <s> into a surface of the kind <cr> draws to (an X
+ * pixmap, usually), so that it does not have to be converted and uploaded
+ * again each time it is painted. */
+cairo_surface_t * surface_new_similar (cairo_t * cr, cairo_surface_t * s)
+{
+    cairo_surface_t * similar = cairo_surface_create_similar (cairo_get_target
+     (cr), cairo_surface_get_content (s), cairo_image_surface_get_width (s),
+     cairo_image_surface_get_height (s));
+
+    cairo_t * cr2 = cairo_create (similar);
+    cairo_set_operator (cr2, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_surface (cr2, s, 0, 0);
+    cairo_paint (cr2);
+    cairo_destroy (cr2);
+
+    return similar;
+}
+
+/* Returns TRUE if <cr> draws to memory, where image surfaces can be used as
+ * they are. */
+gboolean surface_is_image_target (cairo_t * cr)
+{
+    return cairo_surface_get_type (cairo_get_target (cr)) ==
+     CAIRO_SURFACE_TYPE_IMAGE;
+}
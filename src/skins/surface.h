@@ -30,5 +30,7 @@ cairo_surface_t * surface_new_from_file (const gchar * name);
 guint32 surface_get_pixel (cairo_surface_t * s, gint x, gint y);
 void surface_copy_rect (cairo_surface_t * a, gint ax, gint ay, gint w, gint h,
  cairo_surface_t * b, gint bx, gint by);
+cairo_surface_t * surface_new_similar (cairo_t * cr, cairo_surface_t * s);
+gboolean surface_is_image_target (cairo_t * cr);
 
 #endif
@@ -24,6 +24,7 @@
  */
 
 #include <string.h>
+#include <sys/stat.h>
 #include <gtk/gtk.h>
 
 #include <audacious/drct.h>
@@ -54,9 +55,8 @@ enum PresetViewCols {
 
 static gfloat equalizerwin_get_preamp (void);
 static gfloat equalizerwin_get_band (gint band);
-static void equalizerwin_set_preamp (gfloat preamp);
-static void equalizerwin_set_band (gint band, gfloat value);
 
+static Index * get_preset_file (const gchar * uri, gboolean winamp);
 static void position_cb (void * data, void * user_data);
 
 GtkWidget *equalizerwin;
@@ -81,6 +81,17 @@ static GtkWidget *equalizerwin_volume, *equalizerwin_balance;
 
 static Index * equalizer_presets = NULL, * equalizer_auto_presets = NULL;
 
+/* Parsed preset files, keyed by URI.  An entry is reused as long as the
+ * file's modification time and size are unchanged. */
+typedef struct {
+    gboolean winamp;
+    time_t mtime;
+    off_t size;
+    Index * presets;
+} PresetFile;
+
+static GHashTable * preset_files = NULL;
+
 static void
 equalizer_preset_free(EqualizerPreset * preset)
 {
@@ -99,6 +110,14 @@ static void free_presets (Index * presets)
     index_free (presets);
 }
 
+static void preset_file_free (PresetFile * file)
+{
+    if (file->presets)
+        free_presets (file->presets);
+
+    g_slice_free (PresetFile, file);
+}
+
 void equalizerwin_set_shape (void)
 {
     gint id = config.equalizer_shaded ? SKIN_MASK_EQ_SHADE : SKIN_MASK_EQ;
@@ -139,9 +158,12 @@ equalizerwin_apply_preset(EqualizerPreset *preset)
 
     gint i;
 
-    equalizerwin_set_preamp(preset->preamp);
+    /* set all the sliders first so that the equalizer is updated only once */
+    eq_slider_set_val (equalizerwin_preamp, preset->preamp);
     for (i = 0; i < AUD_EQUALIZER_NBANDS; i++)
-        equalizerwin_set_band(i, preset->bands[i]);
+        eq_slider_set_val (equalizerwin_bands[i], preset->bands[i]);
+
+    equalizerwin_eq_changed();
 }
 
 static void eq_on_cb (GtkWidget * button, GdkEventButton * event)
@@ -398,6 +420,12 @@ static void equalizerwin_destroyed (void)
     free_presets (equalizer_auto_presets);
     equalizer_presets = NULL;
     equalizer_auto_presets = NULL;
+
+    if (preset_files)
+    {
+        g_hash_table_destroy (preset_files);
+        preset_files = NULL;
+    }
 }
 
 void
@@ -476,12 +504,7 @@ static bool_t equalizerwin_load_preset (Index * list, const char * name)
     if (p < 0)
         return FALSE;
 
-    EqualizerPreset * preset = index_get (list, p);
-    equalizerwin_set_preamp (preset->preamp);
-
-    for (int i = 0; i < AUD_EQUALIZER_NBANDS; i ++)
-        equalizerwin_set_band (i, preset->bands[i]);
-
+    equalizerwin_apply_preset (index_get (list, p));
     return TRUE;
 }
 
@@ -562,38 +585,14 @@ equalizerwin_delete_selected_presets(GtkTreeView *view, gchar *filename)
     }
 }
 
-static void
-equalizerwin_read_winamp_eqf(VFSFile * file)
-{
-    Index * presets;
-    if ((presets = aud_import_winamp_eqf(file)) == NULL)
-        return;
-
-    if (! index_count (presets))
-        goto DONE;
-
-    /* just get the first preset --asphyx */
-    EqualizerPreset * preset = index_get (presets, 0);
-    equalizerwin_set_preamp(preset->preamp);
-
-    for (int i = 0; i < AUD_EQUALIZER_NBANDS; i ++)
-        equalizerwin_set_band(i, preset->bands[i]);
-
-    equalizerwin_eq_changed();
-
-DONE:
-    free_presets (presets);
-}
-
 static gboolean equalizerwin_read_aud_preset (const gchar * file)
 {
-    EqualizerPreset * preset = aud_load_preset_file (file);
+    Index * presets = get_preset_file (file, FALSE);
 
-    if (preset == NULL)
+    if (! presets || ! index_count (presets))
         return FALSE;
 
-    equalizerwin_apply_preset (preset);
-    equalizer_preset_free (preset);
+    equalizerwin_apply_preset (index_get (presets, 0));
     return TRUE;
 }
 
@@ -761,36 +760,96 @@ open_vfs_file(const gchar *filename, const gchar *mode)
     return file;
 }
 
+static Index * load_preset_file (const gchar * uri, gboolean winamp)
+{
+    if (winamp)
+    {
+        VFSFile * file = open_vfs_file (uri, "rb");
+        if (! file)
+            return NULL;
+
+        Index * presets = aud_import_winamp_eqf (file);
+        vfs_fclose (file);
+        return presets;
+    }
+
+    EqualizerPreset * preset = aud_load_preset_file (uri);
+    if (! preset)
+        return NULL;
+
+    Index * presets = index_new ();
+    index_append (presets, preset);
+    return presets;
+}
+
+/* Returns the presets in a file, parsing it only if it has changed since
+ * the last call.  The list belongs to the cache; copy what you keep. */
+static Index * get_preset_file (const gchar * uri, gboolean winamp)
+{
+    if (! preset_files)
+        preset_files = g_hash_table_new_full (g_str_hash, g_str_equal,
+         g_free, (GDestroyNotify) preset_file_free);
+
+    /* files that cannot be stat'ed (remote URIs) are always re-read */
+    gchar * path = g_filename_from_uri (uri, NULL, NULL);
+    struct stat st;
+    gboolean local = FALSE;
+
+    if (path)
+    {
+        if (stat (path, & st) < 0)
+        {
+            g_free (path);
+            g_hash_table_remove (preset_files, uri);
+            return NULL;
+        }
+
+        local = TRUE;
+        g_free (path);
+    }
+
+    PresetFile * file = g_hash_table_lookup (preset_files, uri);
+
+    if (file && local && file->winamp == winamp && file->mtime == st.st_mtime
+     && file->size == st.st_size)
+        return file->presets;
+
+    file = g_slice_new (PresetFile);
+    file->winamp = winamp;
+    file->mtime = local ? st.st_mtime : 0;
+    file->size = local ? st.st_size : 0;
+    file->presets = load_preset_file (uri, winamp);
+
+    g_hash_table_replace (preset_files, g_strdup (uri), file);
+    return file->presets;
+}
+
 static void
 load_winamp_file(const gchar * filename)
 {
-    VFSFile *file;
-
-    if (!(file = open_vfs_file(filename, "rb")))
-        return;
+    Index * presets = get_preset_file (filename, TRUE);
 
-    equalizerwin_read_winamp_eqf(file);
-    vfs_fclose(file);
+    /* just get the first preset --asphyx */
+    if (presets && index_count (presets))
+        equalizerwin_apply_preset (index_get (presets, 0));
 }
 
 static void
 import_winamp_file(const gchar * filename)
 {
-    VFSFile * file = open_vfs_file (filename, "r");
-    if (! file)
+    Index * presets = get_preset_file (filename, TRUE);
+    if (! presets)
         return;
 
-    Index * list = aud_import_winamp_eqf (file);
-    if (! list)
-        goto CLOSE;
-
-    index_merge_append (equalizer_presets, list);
-    index_free (list);
+    for (int p = 0; p < index_count (presets); p ++)
+    {
+        EqualizerPreset * preset = g_memdup (index_get (presets, p),
+         sizeof (EqualizerPreset));
+        preset->name = g_strdup (preset->name);
+        index_append (equalizer_presets, preset);
+    }
 
     aud_equalizer_write_preset_file(equalizer_presets, "eq.preset");
-
-CLOSE:
-    vfs_fclose(file);
 }
 
 static gboolean save_winamp_file (const gchar * filename)
@@ -935,19 +994,6 @@ static GtkWidget * equalizerwin_create_list_window (Index * preset_list,
     return *window;
 }
 
-static void equalizerwin_set_preamp (gfloat preamp)
-{
-    eq_slider_set_val (equalizerwin_preamp, preamp);
-    equalizerwin_eq_changed();
-}
-
-static void equalizerwin_set_band (gint band, gfloat value)
-{
-    g_return_if_fail(band >= 0 && band < AUD_EQUALIZER_NBANDS);
-    eq_slider_set_val (equalizerwin_bands[band], value);
-    equalizerwin_eq_changed();
-}
-
 static gfloat equalizerwin_get_preamp (void)
 {
     return eq_slider_get_val (equalizerwin_preamp);
@@ -1002,11 +1048,8 @@ action_equ_load_default_preset(void)
 void
 action_equ_zero_preset(void)
 {
-    gint i;
-
-    equalizerwin_set_preamp(0);
-    for (i = 0; i < AUD_EQUALIZER_NBANDS; i++)
-        equalizerwin_set_band(i, 0);
+    EqualizerPreset zero = {NULL};
+    equalizerwin_apply_preset(&zero);
 }
 
 void
@@ -1019,9 +1062,7 @@ action_equ_load_preset_file(void)
     if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT)
     {
         file_uri = gtk_file_chooser_get_uri(GTK_FILE_CHOOSER(dialog));
-        EqualizerPreset *preset = aud_load_preset_file(file_uri);
-        equalizerwin_apply_preset(preset);
-        equalizer_preset_free(preset);
+        equalizerwin_read_aud_preset(file_uri);
         g_free(file_uri);
     }
     gtk_widget_destroy(dialog);
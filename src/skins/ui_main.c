@@ -62,6 +62,8 @@
 #include "ui_vis.h"
 #include "util.h"
 
+#include "../ui-common/update_timer.h"
+
 #define SEEK_THRESHOLD 200 /* milliseconds */
 #define SEEK_TIMEOUT 100 /* milliseconds */
 #define SEEK_SPEED 50 /* milliseconds per pixel */
@@ -110,7 +112,11 @@ static guint mainwin_volume_release_timeout = 0;
 static int ab_position_a = -1;
 static int ab_position_b = -1;
 
+static UpdateTimer update_timer;
+static gint last_volume = -1, last_balance = G_MININT;
+
 static void change_timer_mode(void);
+static void mainwin_volume_poll (void);
 static void mainwin_position_motion_cb (void);
 static void mainwin_position_release_cb (void);
 static void mainwin_set_volume_diff (gint diff);
@@ -1051,7 +1057,7 @@ static void change_timer_mode(void) {
     else
         set_timer_mode(TIMER_ELAPSED);
     if (aud_drct_get_playing())
-        mainwin_update_song_info();
+        update_timer_update (& update_timer);
 }
 
 void
@@ -1450,6 +1456,11 @@ static void show_widgets (void)
 static gboolean state_cb (GtkWidget * widget, GdkEventWindowState * event,
  void * unused)
 {
+    /* the other windows are transient for this one and minimized along */
+    if (event->changed_mask & GDK_WINDOW_STATE_ICONIFIED)
+        update_timer_set_hidden (& update_timer, (event->new_window_state &
+         GDK_WINDOW_STATE_ICONIFIED) ? TRUE : FALSE);
+
     if (event->changed_mask & GDK_WINDOW_STATE_STICKY)
     {
         config.sticky = (event->new_window_state & GDK_WINDOW_STATE_STICKY) ?
@@ -1515,6 +1526,8 @@ mainwin_create_window(void)
 
 void mainwin_unhook (void)
 {
+    update_timer_stop (& update_timer);
+
     if (seek_source != 0)
     {
         g_source_remove (seek_source);
@@ -1538,18 +1551,36 @@ mainwin_create(void)
 
     hook_associate ("show main menu", (HookFunction) show_main_menu, 0);
     status_message_enabled = TRUE;
+
+    update_timer_start (& update_timer, "skins", mainwin_update_song_info);
+
+    /* There is no hook for volume changes, so the volume is polled.  The
+     * equalizer window does not exist yet, so wait for the first poll. */
+    last_volume = -1;
+    last_balance = G_MININT;
+    update_timer_set_poll (& update_timer, mainwin_volume_poll);
 }
 
-static void mainwin_update_volume (void)
+static void mainwin_volume_poll (void)
 {
     gint volume, balance;
 
     aud_drct_get_volume_main (& volume);
     aud_drct_get_volume_balance (& balance);
-    mainwin_set_volume_slider (volume);
-    mainwin_set_balance_slider (balance);
-    equalizerwin_set_volume_slider (volume);
-    equalizerwin_set_balance_slider (balance);
+
+    if (volume != last_volume)
+    {
+        mainwin_set_volume_slider (volume);
+        equalizerwin_set_volume_slider (volume);
+        last_volume = volume;
+    }
+
+    if (balance != last_balance)
+    {
+        mainwin_set_balance_slider (balance);
+        equalizerwin_set_balance_slider (balance);
+        last_balance = balance;
+    }
 }
 
 static void mainwin_update_time_display (gint time, gint length)
@@ -1596,8 +1627,6 @@ static void mainwin_update_time_slider (gint time, gint length)
 
 void mainwin_update_song_info (void)
 {
-    mainwin_update_volume ();
-
     if (! aud_drct_get_playing ())
         return;
 
@@ -1611,6 +1640,10 @@ void mainwin_update_song_info (void)
     mainwin_update_time_display (time, length);
     mainwin_update_time_slider (time, length);
 
+    /* wake up again when the counter or the position slider next changes */
+    update_timer_set_alignment (& update_timer, config.timer_mode ==
+     TIMER_REMAINING, length > 0 ? length / 219 : 0);
+
     /* Ugh, this does NOT belong here. -jlindgren */
     if (ab_position_a > -1 && ab_position_b > -1 && time >= ab_position_b)
     {
@@ -1806,12 +1839,14 @@ void action_ab_set (void)
             if (time > ab_position_a)
                 ab_position_b = time;
             mainwin_release_info_text();
+            update_timer_set_deadline (& update_timer, ab_position_b);
         }
         else
         {
             ab_position_a = aud_drct_get_time();
             ab_position_b = -1;
             mainwin_lock_info_text("LOOP-POINT A POSITION RESET.");
+            update_timer_set_deadline (& update_timer, -1);
         }
     }
 }
@@ -1822,5 +1857,6 @@ void action_ab_clear (void)
     {
         ab_position_a = ab_position_b = -1;
         mainwin_release_info_text();
+        update_timer_set_deadline (& update_timer, -1);
     }
 }
@@ -33,6 +33,8 @@
 #include "ui_vis.h"
 #include "util.h"
 
+#include "../vis-common/spectrum.h"
+
 static void title_change (void)
 {
     if (aud_drct_get_ready ())
@@ -196,45 +198,18 @@ static void render_multi_pcm (const gfloat * pcm, gint channels)
 static void make_log_graph (const gfloat * freq, gint bands, gint db_range, gint
  int_range, guchar * graph)
 {
-    static gint last_bands = 0;
-    static gfloat * xscale = NULL;
+    static SpectrumMap map;
+    gfloat level[bands];
 
-    /* conversion table for the x-axis */
-    if (bands != last_bands)
-    {
-        xscale = g_realloc (xscale, sizeof (gfloat) * (bands + 1));
-        for (gint i = 0; i <= bands; i ++)
-            xscale[i] = powf (257, (gfloat) i / bands) - 1;
-
-        last_bands = bands;
-    }
+    /* fudge factor to make the graph have the same overall height as a
+       12-band one no matter how many bands there are */
+    spectrum_map_set (& map, bands, (gfloat) bands / 12);
+    spectrum_map_apply (& map, freq, level);
 
     for (gint i = 0; i < bands; i ++)
     {
-        /* sum up values in freq array between xscale[i] and xscale[i + 1],
-           including fractional parts */
-        gint a = ceilf (xscale[i]);
-        gint b = floorf (xscale[i + 1]);
-        gfloat sum = 0;
-
-        if (b < a)
-            sum += freq[b] * (xscale[i + 1] - xscale[i]);
-        else
-        {
-            if (a > 0)
-                sum += freq[a - 1] * (a - xscale[i]);
-            for (; a < b; a ++)
-                sum += freq[a];
-            if (b < 256)
-                sum += freq[b] * (xscale[i + 1] - b);
-        }
-
-        /* fudge factor to make the graph have the same overall height as a
-           12-band one no matter how many bands there are */
-        sum = sum * bands / 12;
-
         /* convert to dB */
-        gfloat val = 20 * log10f (sum);
+        gfloat val = 20 * log10f (level[i]);
 
         /* scale (-db_range, 0.0) to (0.0, int_range) */
         val = (1.0 + val / db_range) * int_range;
@@ -792,6 +792,19 @@ static void update_cb (void * unused, void * another)
     gint old = active_playlist;
 
     active_playlist = aud_playlist_get_active ();
+
+    gint at, count;
+    gint level = aud_playlist_updated_range (active_playlist, & at, & count);
+
+    /* a selection change only needs the affected rows redrawn */
+    if (active_playlist == old && ! song_changed && level ==
+     PLAYLIST_UPDATE_SELECTION)
+    {
+        ui_skinned_playlist_update_rows (playlistwin_list, at, count);
+        playlistwin_update_info ();
+        return;
+    }
+
     active_length = aud_playlist_entry_count (active_playlist);
     get_title ();
 
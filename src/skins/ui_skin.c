@@ -41,6 +41,7 @@
 #include "ui_main.h"
 #include "ui_playlist.h"
 #include "ui_skin.h"
+#include "ui_skinned_equalizer_graph.h"
 #include "ui_skinned_number.h"
 #include "ui_skinned_playstatus.h"
 #include "ui_skinned_textbox.h"
@@ -146,6 +147,7 @@ gboolean active_skin_load (const gchar * path)
     mainwin_refresh_hints ();
     textbox_update_all ();
     ui_vis_set_colors ();
+    eq_graph_skin_changed ();
     gtk_widget_queue_draw (mainwin);
     gtk_widget_queue_draw (equalizerwin);
     gtk_widget_queue_draw (playlistwin);
@@ -188,6 +190,12 @@ skin_free(Skin * skin)
             cairo_surface_destroy (skin->pixmaps[i]);
             skin->pixmaps[i] = NULL;
         }
+
+        if (skin->similar[i])
+        {
+            cairo_surface_destroy (skin->similar[i]);
+            skin->similar[i] = NULL;
+        }
     }
 
     for (i = 0; i < SKIN_MASK_COUNT; i++) {
@@ -299,28 +307,20 @@ skin_pixmap_locate_basenames(const Skin * skin,
 }
 
 
-static gboolean
-skin_load_pixmap_id(Skin * skin, SkinPixmapId id, const gchar * path_p)
-{
-    const SkinPixmapIdMapping *pixmap_id_mapping;
-    gchar *filename;
-
-    g_return_val_if_fail(skin != NULL, FALSE);
-    g_return_val_if_fail(id < SKIN_PIXMAP_COUNT, FALSE);
-    g_return_val_if_fail(! skin->pixmaps[id], FALSE);
-
-    pixmap_id_mapping = skin_pixmap_id_lookup(id);
-    g_return_val_if_fail(pixmap_id_mapping != NULL, FALSE);
-
-    filename = skin_pixmap_locate_basenames(skin, pixmap_id_mapping, path_p);
+/* Pixmaps are decoded on a small thread pool while the main thread parses
+ * the text files and builds the window masks.  Decoding only touches
+ * GdkPixbuf and cairo image surfaces, so it is safe off the main thread. */
+#define SKIN_LOAD_THREADS 4
 
-    if (filename == NULL)
-        return FALSE;
+typedef struct {
+    gchar * filename;
+    cairo_surface_t * surface;
+} PixmapJob;
 
-    skin->pixmaps[id] = surface_new_from_file (filename);
-
-    g_free (filename);
-    return skin->pixmaps[id] ? TRUE : FALSE;
+static void pixmap_decode (void * data, void * unused)
+{
+    PixmapJob * job = data;
+    job->surface = surface_new_from_file (job->filename);
 }
 
 static void skin_mask_create (Skin * skin, const gchar * path, gint id,
@@ -793,27 +793,35 @@ skin_numbers_generate_dash(Skin * skin)
 }
 
 static gboolean
-skin_load_pixmaps(Skin * skin, const gchar * path)
+skin_load_pixmaps(Skin * skin, const gchar * path, gchar * * filenames)
 {
     guint i;
     gchar *filename;
     INIFile *inifile;
+    PixmapJob jobs[SKIN_PIXMAP_COUNT];
+    GThreadPool * pool;
+    GTimer * timer;
+    gboolean ok = TRUE;
 
     if(!skin) return FALSE;
     if(!path) return FALSE;
 
     AUDDBG("Loading pixmaps in %s\n", path);
 
-    for (i = 0; i < SKIN_PIXMAP_COUNT; i++)
-        if (! skin_load_pixmap_id (skin, i, path))
-            return FALSE;
+    timer = g_timer_new ();
+    pool = g_thread_pool_new (pixmap_decode, NULL, SKIN_LOAD_THREADS, FALSE,
+     NULL);
 
-    if (skin->pixmaps[SKIN_TEXT])
-        skin_get_textcolors (skin, skin->pixmaps[SKIN_TEXT]);
+    for (i = 0; i < SKIN_PIXMAP_COUNT; i++)
+    {
+        jobs[i].filename = filenames[i];
+        jobs[i].surface = NULL;
 
-    if (skin->pixmaps[SKIN_NUMBERS] && cairo_image_surface_get_width
-     (skin->pixmaps[SKIN_NUMBERS]) < 108)
-        skin_numbers_generate_dash (skin);
+        if (pool)
+            g_thread_pool_push (pool, & jobs[i], NULL);
+        else
+            pixmap_decode (& jobs[i], NULL);
+    }
 
     filename = find_file_case_uri (path, "pledit.txt");
     inifile = (filename != NULL) ? open_ini_file (filename) : NULL;
@@ -840,24 +848,59 @@ skin_load_pixmaps(Skin * skin, const gchar * path)
 
     skin_load_viscolor(skin, path, "viscolor.txt");
 
+    if (pool)
+        g_thread_pool_free (pool, FALSE, TRUE);
+
+    AUDDBG ("Decoded %d pixmaps in %.1f ms.\n", SKIN_PIXMAP_COUNT,
+     g_timer_elapsed (timer, NULL) * 1000);
+    g_timer_destroy (timer);
+
+    for (i = 0; i < SKIN_PIXMAP_COUNT; i++)
+    {
+        skin->pixmaps[i] = jobs[i].surface;
+        if (! skin->pixmaps[i])
+            ok = FALSE;
+    }
+
+    if (! ok)
+        return FALSE;
+
+    if (skin->pixmaps[SKIN_TEXT])
+        skin_get_textcolors (skin, skin->pixmaps[SKIN_TEXT]);
+
+    if (skin->pixmaps[SKIN_NUMBERS] && cairo_image_surface_get_width
+     (skin->pixmaps[SKIN_NUMBERS]) < 108)
+        skin_numbers_generate_dash (skin);
+
     return TRUE;
 }
 
+static void
+skin_free_filenames(gchar * * filenames)
+{
+    guint i;
+    for (i = 0; i < SKIN_PIXMAP_COUNT; i++)
+        g_free(filenames[i]);
+}
+
 /**
- * Checks if all pixmap files exist that skin needs.
+ * Locates all pixmap files the skin needs.  Returns FALSE if any is missing.
  */
 static gboolean
-skin_check_pixmaps(const Skin * skin, const gchar * skin_path)
+skin_locate_pixmaps(const Skin * skin, const gchar * skin_path,
+                    gchar * * filenames)
 {
     guint i;
     for (i = 0; i < SKIN_PIXMAP_COUNT; i++)
     {
-        gchar *filename = skin_pixmap_locate_basenames(skin,
-                                                       skin_pixmap_id_lookup(i),
-                                                       skin_path);
-        if (!filename)
+        filenames[i] = skin_pixmap_locate_basenames(skin,
+                                                    skin_pixmap_id_lookup(i),
+                                                    skin_path);
+        if (!filenames[i])
+        {
+            skin_free_filenames(filenames);
             return FALSE;
-        g_free(filename);
+        }
     }
     return TRUE;
 }
@@ -866,7 +909,10 @@ static gboolean
 skin_load_nolock(Skin * skin, const gchar * path, gboolean force)
 {
     gchar *newpath, *skin_path;
+    gchar *filenames[SKIN_PIXMAP_COUNT] = {NULL};
     int archive = 0;
+    GTimer *timer;
+    gboolean ok;
 
     AUDDBG("Attempt to load skin \"%s\"\n", path);
 
@@ -893,11 +939,14 @@ skin_load_nolock(Skin * skin, const gchar * path, gboolean force)
         skin_path = g_strdup(path);
     }
 
+    timer = g_timer_new();
+
     // Check if skin path has all necessary files.
-    if (!skin_check_pixmaps(skin, skin_path)) {
+    if (!skin_locate_pixmaps(skin, skin_path, filenames)) {
+        g_timer_destroy(timer);
+        AUDDBG("Skin path (%s) doesn't have all wanted pixmaps\n", skin_path);
         if(archive) del_directory(skin_path);
         g_free(skin_path);
-        AUDDBG("Skin path (%s) doesn't have all wanted pixmaps\n", skin_path);
         return FALSE;
     }
 
@@ -914,19 +963,24 @@ skin_load_nolock(Skin * skin, const gchar * path, gboolean force)
     /* Parse the hints for this skin. */
     skin_parse_hints(skin, skin_path);
 
-    if (!skin_load_pixmaps(skin, skin_path)) {
-        if(archive) del_directory(skin_path);
-        g_free(skin_path);
-        AUDDBG("Skin loading failed\n");
-        return FALSE;
-    }
+    ok = skin_load_pixmaps(skin, skin_path, filenames);
+    skin_free_filenames(filenames);
 
     if(archive) del_directory(skin_path);
     g_free(skin_path);
 
+    if (!ok) {
+        g_timer_destroy(timer);
+        AUDDBG("Skin loading failed\n");
+        return FALSE;
+    }
+
     mainwin_set_shape ();
     equalizerwin_set_shape ();
 
+    AUDDBG("Skin loaded in %.1f ms.\n", g_timer_elapsed(timer, NULL) * 1000);
+    g_timer_destroy(timer);
+
     return TRUE;
 }
 
@@ -1010,11 +1064,29 @@ static gboolean skin_load (Skin * skin, const gchar * path)
 void skin_draw_pixbuf (cairo_t * cr, SkinPixmapId id, gint xsrc, gint ysrc, gint
  xdest, gint ydest, gint width, gint height)
 {
-    if (! active_skin->pixmaps[id])
+    cairo_surface_t * s = active_skin->pixmaps[id];
+    if (! s)
         return;
 
-    cairo_set_source_surface (cr, active_skin->pixmaps[id], xdest - xsrc,
-     ydest - ysrc);
+    /* blit from a copy in the window's format rather than converting the
+     * image on every draw */
+    if (! surface_is_image_target (cr))
+    {
+        cairo_surface_t * similar = active_skin->similar[id];
+
+        if (! similar || cairo_surface_get_type (similar) !=
+         cairo_surface_get_type (cairo_get_target (cr)))
+        {
+            if (similar)
+                cairo_surface_destroy (similar);
+
+            similar = active_skin->similar[id] = surface_new_similar (cr, s);
+        }
+
+        s = similar;
+    }
+
+    cairo_set_source_surface (cr, s, xdest - xsrc, ydest - ysrc);
     cairo_rectangle (cr, xdest, ydest, width, height);
     cairo_fill (cr);
 }
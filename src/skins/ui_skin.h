@@ -169,6 +169,7 @@ typedef struct {
 typedef struct {
     gchar *path;
     cairo_surface_t * pixmaps[SKIN_PIXMAP_COUNT];
+    cairo_surface_t * similar[SKIN_PIXMAP_COUNT]; /* created when first drawn */
     guint32 colors[SKIN_COLOR_COUNT];
     guint32 vis_colors[24];
     cairo_region_t * masks[SKIN_MASK_COUNT];
@@ -22,6 +22,8 @@
  * along with this program;  If not, see <http://www.gnu.org/licenses>.
  */
 
+#include <string.h>
+
 #include <audacious/misc.h>
 
 #include "draw-compat.h"
@@ -77,18 +79,32 @@ gdouble eval_spline (const gdouble * xa, const gdouble * ya, const gdouble * y2a
              (b * b * b - b) * y2a[khi]) * (h * h) / 6.0);
 }
 
-DRAW_FUNC_BEGIN (eq_graph_draw)
-    static const gdouble x[10] = {0, 11, 23, 35, 47, 59, 71, 83, 97, 109};
+/* The graph is rendered once into a surface and repainted from there until
+ * the bands, the preamp or the spline colors change. */
+static struct {
+    cairo_surface_t * surface;
+    gdouble bands[AUD_EQUALIZER_NBANDS];
+    gdouble preamp;
+    guint32 cols[19];
+} graph_cache;
 
-    skin_draw_pixbuf (cr, SKIN_EQMAIN, 0, 294, 0, 0, 113, 19);
-    skin_draw_pixbuf (cr, SKIN_EQMAIN, 0, 314, 0, 9 + (aud_get_double (NULL,
-     "equalizer_preamp") * 9 + EQUALIZER_MAX_GAIN / 2) / EQUALIZER_MAX_GAIN, 113, 1);
+static void graph_cache_clear (void)
+{
+    if (graph_cache.surface)
+    {
+        cairo_surface_destroy (graph_cache.surface);
+        graph_cache.surface = NULL;
+    }
+}
 
-    guint32 cols[19];
-    skin_get_eq_spline_colors(active_skin, cols);
+static void eq_graph_render (cairo_t * cr, const gdouble * bands,
+ gdouble preamp, const guint32 * cols)
+{
+    static const gdouble x[10] = {0, 11, 23, 35, 47, 59, 71, 83, 97, 109};
 
-    gdouble bands[AUD_EQUALIZER_NBANDS];
-    aud_eq_get_bands (bands);
+    skin_draw_pixbuf (cr, SKIN_EQMAIN, 0, 294, 0, 0, 113, 19);
+    skin_draw_pixbuf (cr, SKIN_EQMAIN, 0, 314, 0, 9 + (preamp * 9 +
+     EQUALIZER_MAX_GAIN / 2) / EQUALIZER_MAX_GAIN, 113, 1);
 
     gdouble yf[10];
     init_spline (x, bands, 10, yf);
@@ -127,6 +143,35 @@ DRAW_FUNC_BEGIN (eq_graph_draw)
             cairo_fill (cr);
         }
     }
+}
+
+DRAW_FUNC_BEGIN (eq_graph_draw)
+    gdouble bands[AUD_EQUALIZER_NBANDS];
+    aud_eq_get_bands (bands);
+    gdouble preamp = aud_get_double (NULL, "equalizer_preamp");
+
+    guint32 cols[19];
+    skin_get_eq_spline_colors (active_skin, cols);
+
+    if (! graph_cache.surface || graph_cache.preamp != preamp || memcmp
+     (graph_cache.bands, bands, sizeof bands) || memcmp (graph_cache.cols,
+     cols, sizeof cols))
+    {
+        if (! graph_cache.surface)
+            graph_cache.surface = cairo_surface_create_similar (cairo_get_target
+             (cr), CAIRO_CONTENT_COLOR, 113, 19);
+
+        cairo_t * gcr = cairo_create (graph_cache.surface);
+        eq_graph_render (gcr, bands, preamp, cols);
+        cairo_destroy (gcr);
+
+        memcpy (graph_cache.bands, bands, sizeof bands);
+        graph_cache.preamp = preamp;
+        memcpy (graph_cache.cols, cols, sizeof cols);
+    }
+
+    cairo_set_source_surface (cr, graph_cache.surface, 0, 0);
+    cairo_paint (cr);
 DRAW_FUNC_END
 
 GtkWidget * eq_graph_new (void)
@@ -134,6 +179,7 @@ GtkWidget * eq_graph_new (void)
     GtkWidget * graph = gtk_drawing_area_new ();
     gtk_widget_set_size_request (graph, 113, 19);
     DRAW_CONNECT (graph, eq_graph_draw);
+    g_signal_connect (graph, "destroy", (GCallback) graph_cache_clear, NULL);
     return graph;
 }
 
@@ -141,3 +187,8 @@ void eq_graph_update (GtkWidget * graph)
 {
     gtk_widget_queue_draw (graph);
 }
+
+void eq_graph_skin_changed (void)
+{
+    graph_cache_clear ();
+}
@@ -32,5 +32,6 @@
 
 GtkWidget * eq_graph_new ();
 void eq_graph_update (GtkWidget * graph);
+void eq_graph_skin_changed (void);
 
 #endif
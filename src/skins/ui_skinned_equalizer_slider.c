@@ -141,10 +141,16 @@ void eq_slider_set_val (GtkWidget * slider, gfloat val)
     if (data->pressed)
         return;
 
+    gint pos = 25 - (gint) (val * 25 / EQUALIZER_MAX_GAIN);
+    pos = CLAMP (pos, 0, 50);
+
     data->val = val;
-    data->pos = 25 - (gint) (val * 25 / EQUALIZER_MAX_GAIN);
-    data->pos = CLAMP (data->pos, 0, 50);
 
+    /* called for every slider whenever any band changes */
+    if (pos == data->pos)
+        return;
+
+    data->pos = pos;
     gtk_widget_queue_draw (slider);
 }
 
@@ -115,6 +115,27 @@ static gint adjust_position (PlaylistData * data, gboolean relative, gint
     return position;
 }
 
+static void queue_rows (GtkWidget * list, PlaylistData * data, gint at,
+ gint count)
+{
+    gint top = MAX (at, data->first);
+    gint bottom = MIN (at + count, data->first + data->rows);
+
+    if (bottom > top)
+        gtk_widget_queue_draw_area (list, 0, data->offset + data->row_height *
+         (top - data->first), data->width, data->row_height * (bottom - top));
+}
+
+static void queue_hover (GtkWidget * list, PlaylistData * data, gint hover)
+{
+    if (hover < data->first || hover > data->first + data->rows)
+        return;
+
+    /* the hover line is 2 pixels wide, centered on the row boundary */
+    gtk_widget_queue_draw_area (list, 0, data->offset + data->row_height *
+     (hover - data->first) - 1, data->width, 2);
+}
+
 static void cancel_all (GtkWidget * list, PlaylistData * data)
 {
     data->drag = FALSE;
@@ -127,8 +148,8 @@ static void cancel_all (GtkWidget * list, PlaylistData * data)
 
     if (data->hover != -1)
     {
+        queue_hover (list, data, data->hover);
         data->hover = -1;
-        gtk_widget_queue_draw (list);
     }
 
     popup_hide (list, data);
@@ -143,6 +164,18 @@ DRAW_FUNC_BEGIN (playlist_draw)
     PangoLayout * layout;
     gint width;
 
+    /* rows inside the damaged area; column widths still depend on all rows */
+    GdkRectangle clip;
+    if (! gdk_cairo_get_clip_rectangle (cr, & clip))
+        return TRUE;
+
+    gint start = data->first + MAX (clip.y - data->offset, 0) /
+     data->row_height;
+    gint end = data->first + (MAX (clip.y + clip.height - data->offset, 0) +
+     data->row_height - 1) / data->row_height;
+
+    end = MIN (end, MIN (data->first + data->rows, active_length));
+
     /* background */
 
     set_cairo_color (cr, active_skin->colors[SKIN_PLEDIT_NORMALBG]);
@@ -150,7 +183,7 @@ DRAW_FUNC_BEGIN (playlist_draw)
 
     /* playlist title */
 
-    if (data->offset)
+    if (data->offset && clip.y < data->offset)
     {
         layout = gtk_widget_create_pango_layout (wid, active_title);
         pango_layout_set_font_description (layout, data->font);
@@ -167,8 +200,7 @@ DRAW_FUNC_BEGIN (playlist_draw)
 
     /* selection highlight */
 
-    for (gint i = data->first; i < data->first + data->rows && i <
-     active_length; i ++)
+    for (gint i = start; i < end; i ++)
     {
         if (! aud_playlist_entry_get_selected (active_playlist, i))
             continue;
@@ -198,11 +230,15 @@ DRAW_FUNC_BEGIN (playlist_draw)
             pango_layout_get_pixel_extents (layout, NULL, & rect);
             width = MAX (width, rect.width);
 
-            cairo_move_to (cr, left, data->offset + data->row_height * (i -
-             data->first));
-            set_cairo_color (cr, active_skin->colors[(i == active_entry) ?
-             SKIN_PLEDIT_CURRENT : SKIN_PLEDIT_NORMAL]);
-            pango_cairo_show_layout (cr, layout);
+            if (i >= start && i < end)
+            {
+                cairo_move_to (cr, left, data->offset + data->row_height * (i -
+                 data->first));
+                set_cairo_color (cr, active_skin->colors[(i == active_entry) ?
+                 SKIN_PLEDIT_CURRENT : SKIN_PLEDIT_NORMAL]);
+                pango_cairo_show_layout (cr, layout);
+            }
+
             g_object_unref (layout);
         }
 
@@ -231,11 +267,15 @@ DRAW_FUNC_BEGIN (playlist_draw)
         pango_layout_get_pixel_extents (layout, NULL, & rect);
         width = MAX (width, rect.width);
 
-        cairo_move_to (cr, data->width - right - rect.width, data->offset +
-         data->row_height * (i - data->first));
-        set_cairo_color (cr, active_skin->colors[(i == active_entry) ?
-         SKIN_PLEDIT_CURRENT : SKIN_PLEDIT_NORMAL]);
-        pango_cairo_show_layout (cr, layout);
+        if (i >= start && i < end)
+        {
+            cairo_move_to (cr, data->width - right - rect.width, data->offset +
+             data->row_height * (i - data->first));
+            set_cairo_color (cr, active_skin->colors[(i == active_entry) ?
+             SKIN_PLEDIT_CURRENT : SKIN_PLEDIT_NORMAL]);
+            pango_cairo_show_layout (cr, layout);
+        }
+
         g_object_unref (layout);
     }
 
@@ -264,11 +304,15 @@ DRAW_FUNC_BEGIN (playlist_draw)
             pango_layout_get_pixel_extents (layout, NULL, & rect);
             width = MAX (width, rect.width);
 
-            cairo_move_to (cr, data->width - right - rect.width, data->offset +
-             data->row_height * (i - data->first));
-            set_cairo_color (cr, active_skin->colors[(i == active_entry) ?
-             SKIN_PLEDIT_CURRENT : SKIN_PLEDIT_NORMAL]);
-            pango_cairo_show_layout (cr, layout);
+            if (i >= start && i < end)
+            {
+                cairo_move_to (cr, data->width - right - rect.width,
+                 data->offset + data->row_height * (i - data->first));
+                set_cairo_color (cr, active_skin->colors[(i == active_entry) ?
+                 SKIN_PLEDIT_CURRENT : SKIN_PLEDIT_NORMAL]);
+                pango_cairo_show_layout (cr, layout);
+            }
+
             g_object_unref (layout);
         }
 
@@ -277,8 +321,7 @@ DRAW_FUNC_BEGIN (playlist_draw)
 
     /* titles */
 
-    for (gint i = data->first; i < data->first + data->rows && i <
-     active_length; i ++)
+    for (gint i = start; i < end; i ++)
     {
         gchar * title = aud_playlist_entry_get_title (active_playlist, i, TRUE);
 
@@ -419,6 +462,16 @@ void ui_skinned_playlist_set_font (GtkWidget * list, const gchar * font)
         ui_skinned_playlist_slider_update (data->slider);
 }
 
+/* Redraws the given rows, for changes that do not affect the layout (such as
+ * selection). */
+void ui_skinned_playlist_update_rows (GtkWidget * list, gint at, gint count)
+{
+    PlaylistData * data = g_object_get_data ((GObject *) list, "playlistdata");
+    g_return_if_fail (data);
+
+    queue_rows (list, data, at, count);
+}
+
 void ui_skinned_playlist_update (GtkWidget * list)
 {
     PlaylistData * data = g_object_get_data ((GObject *) list, "playlistdata");
@@ -703,10 +756,17 @@ void ui_skinned_playlist_set_focused (GtkWidget * list, gint row)
     g_return_if_fail (data);
 
     cancel_all (list, data);
+
+    gint old_first = data->first;
+    queue_rows (list, data, data->focused, 1);
+
     data->focused = row;
     scroll_to (data, row);
 
-    gtk_widget_queue_draw (list);
+    if (data->first == old_first)
+        queue_rows (list, data, row, 1);
+    else
+        gtk_widget_queue_draw (list);
 }
 
 void ui_skinned_playlist_hover (GtkWidget * list, gint x, gint y)
@@ -729,8 +789,9 @@ void ui_skinned_playlist_hover (GtkWidget * list, gint x, gint y)
 
     if (new != data->hover)
     {
+        queue_hover (list, data, data->hover);
+        queue_hover (list, data, new);
         data->hover = new;
-        gtk_widget_queue_draw (list);
     }
 }
 
@@ -740,9 +801,9 @@ gint ui_skinned_playlist_hover_end (GtkWidget * list)
     g_return_val_if_fail (data, -1);
 
     gint temp = data->hover;
+    queue_hover (list, data, temp);
     data->hover = -1;
 
-    gtk_widget_queue_draw (list);
     return temp;
 }
 
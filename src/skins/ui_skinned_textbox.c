@@ -29,6 +29,7 @@
 
 #include "draw-compat.h"
 #include "skins_cfg.h"
+#include "surface.h"
 #include "ui_skin.h"
 #include "ui_skinned_textbox.h"
 
@@ -40,6 +41,7 @@ typedef struct {
     gchar * text;
     PangoFontDescription * font;
     cairo_surface_t * buf;
+    cairo_surface_t * similar; /* copy of buf in the window's format */
     gint buf_width;
     gboolean may_scroll, scrolling, backward;
     gint scroll_source;
@@ -52,21 +54,33 @@ DRAW_FUNC_BEGIN (textbox_draw)
     TextboxData * data = g_object_get_data ((GObject *) wid, "textboxdata");
     g_return_val_if_fail (data && data->buf, FALSE);
 
+    /* scrolling repaints the whole textbox every step, so keep the text where
+     * painting it is a plain copy */
+    cairo_surface_t * buf = data->buf;
+
+    if (! surface_is_image_target (cr))
+    {
+        if (! data->similar)
+            data->similar = surface_new_similar (cr, data->buf);
+
+        buf = data->similar;
+    }
+
     if (data->scrolling)
     {
-        cairo_set_source_surface (cr, data->buf, -data->offset, 0);
+        cairo_set_source_surface (cr, buf, -data->offset, 0);
         cairo_paint (cr);
 
         if (-data->offset + data->buf_width < data->width)
         {
-            cairo_set_source_surface (cr, data->buf, -data->offset +
+            cairo_set_source_surface (cr, buf, -data->offset +
              data->buf_width, 0);
             cairo_paint (cr);
         }
     }
     else
     {
-        cairo_set_source_surface (cr, data->buf, 0, 0);
+        cairo_set_source_surface (cr, buf, 0, 0);
         cairo_paint (cr);
     }
 DRAW_FUNC_END
@@ -82,6 +96,8 @@ static gboolean textbox_scroll (GtkWidget * textbox)
         return TRUE;
     }
 
+    gint old_offset = data->offset;
+
     if (config.twoway_scroll && data->backward)
         data->offset --;
     else
@@ -97,7 +113,15 @@ static gboolean textbox_scroll (GtkWidget * textbox)
     if (! config.twoway_scroll && data->offset >= data->buf_width)
         data->offset = 0;
 
-    gtk_widget_queue_draw (textbox);
+    /* move what is already on screen and only draw the uncovered column */
+    GdkWindow * window = gtk_widget_get_window (textbox);
+    gint step = data->offset - old_offset;
+
+    if (window && gtk_widget_get_realized (textbox) && (step == 1 || step == -1))
+        gdk_window_scroll (window, -step, 0);
+    else
+        gtk_widget_queue_draw (textbox);
+
     return TRUE;
 }
 
@@ -231,6 +255,12 @@ static void textbox_render (GtkWidget * textbox, TextboxData * data)
         data->buf = NULL;
     }
 
+    if (data->similar)
+    {
+        cairo_surface_destroy (data->similar);
+        data->similar = NULL;
+    }
+
     data->scrolling = FALSE;
     data->backward = FALSE;
     data->offset = 0;
@@ -356,6 +386,8 @@ static void textbox_destroy (GtkWidget * textbox)
         pango_font_description_free (data->font);
     if (data->buf)
         cairo_surface_destroy (data->buf);
+    if (data->similar)
+        cairo_surface_destroy (data->similar);
     if (data->scroll_source)
         g_source_remove (data->scroll_source);
 
@@ -49,6 +49,10 @@ static struct {
     gboolean voiceprint_advance;
 } vis;
 
+/* the frame on screen; only the columns that change are redrawn */
+static guint32 vis_frame[76 * 16];
+static gboolean vis_frame_valid;
+
 #define RGB_SEEK(x,y) (set = rgb + 76 * (y) + (x))
 #define RGB_SET(c) (* set ++ = (c))
 #define RGB_SET_Y(c) do {* set = (c); set += 76;} while (0)
@@ -96,10 +100,12 @@ void ui_vis_set_colors (void)
         RGB_SET_INDEX (1);
         RGB_SET_INDEX (0);
     }
+
+    vis_frame_valid = FALSE;
 }
 
-DRAW_FUNC_BEGIN (ui_vis_draw)
-    guint32 rgb[76 * 16];
+static void vis_render (guint32 * rgb)
+{
     guint32 * set;
 
     if (config.vis_type != VIS_VOICEPRINT)
@@ -175,7 +181,7 @@ DRAW_FUNC_BEGIN (ui_vis_draw)
         break;
     case VIS_SCOPE:
         if (! vis.active)
-            goto DRAW;
+            break;
 
         switch (config.scope_mode)
         {
@@ -224,10 +230,59 @@ DRAW_FUNC_BEGIN (ui_vis_draw)
         }
         break;
     }
+}
+
+/* Renders a new frame and queues a redraw of the columns that differ from the
+ * frame on screen. */
+static void vis_update (GtkWidget * wid)
+{
+    guint32 rgb[76 * 16];
+    vis_render (rgb);
+
+    gint left = 0, right = 76;
+
+    if (vis_frame_valid)
+    {
+        while (left < right)
+        {
+            gint y;
+            for (y = 0; y < 16 && rgb[76 * y + left] == vis_frame[76 * y + left];
+             y ++)
+                ;
+            if (y < 16)
+                break;
+            left ++;
+        }
+
+        while (right > left)
+        {
+            gint y;
+            for (y = 0; y < 16 && rgb[76 * y + right - 1] == vis_frame[76 * y +
+             right - 1]; y ++)
+                ;
+            if (y < 16)
+                break;
+            right --;
+        }
+    }
+
+    memcpy (vis_frame, rgb, sizeof vis_frame);
+    vis_frame_valid = TRUE;
+
+    if (right > left)
+        gtk_widget_queue_draw_area (wid, left, 0, right - left, 16);
+}
+
+DRAW_FUNC_BEGIN (ui_vis_draw)
+    if (! vis_frame_valid)
+    {
+        vis_render (vis_frame);
+        vis_frame_valid = TRUE;
+    }
 
-DRAW:;
-    cairo_surface_t * surf = cairo_image_surface_create_for_data ((void *) rgb,
-     CAIRO_FORMAT_RGB24, 76, 16, 4 * 76);
+    /* cairo only copies the part inside the damaged area */
+    cairo_surface_t * surf = cairo_image_surface_create_for_data ((void *)
+     vis_frame, CAIRO_FORMAT_RGB24, 76, 16, 4 * 76);
     cairo_set_source_surface (cr, surf, 0, 0);
     cairo_paint (cr);
     cairo_surface_destroy (surf);
@@ -245,6 +300,7 @@ GtkWidget * ui_vis_new (void)
 void ui_vis_clear_data (GtkWidget * wid)
 {
     memset (& vis, 0, sizeof vis);
+    vis_frame_valid = FALSE;
     gtk_widget_queue_draw (wid);
 }
 
@@ -312,5 +368,5 @@ void ui_vis_timeout_func (GtkWidget * widget, guchar * data)
     }
 
     vis.active = TRUE;
-    gtk_widget_queue_draw (widget);
+    vis_update (widget);
 }
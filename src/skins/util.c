@@ -54,18 +54,18 @@ typedef struct
 static void make_directory(const gchar *path, mode_t mode);
 #endif
 
+/* folder -> (lowercase name -> name) for each folder listed so far */
+static GHashTable * dir_cache = NULL;
+
 gchar * find_file_case (const gchar * folder, const gchar * basename)
 {
-    static GHashTable * cache = NULL;
-    GList * list = NULL;
-    void * vlist;
+    GHashTable * names;
 
-    if (cache == NULL)
-        cache = g_hash_table_new (g_str_hash, g_str_equal);
+    if (dir_cache == NULL)
+        dir_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+         (GDestroyNotify) g_hash_table_destroy);
 
-    if (g_hash_table_lookup_extended (cache, folder, NULL, & vlist))
-        list = vlist;
-    else
+    if ((names = g_hash_table_lookup (dir_cache, folder)) == NULL)
     {
         DIR * handle;
         struct dirent * entry;
@@ -73,20 +73,22 @@ gchar * find_file_case (const gchar * folder, const gchar * basename)
         if ((handle = opendir (folder)) == NULL)
             return NULL;
 
+        names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+        /* like strcasecmp(), fold ASCII case only */
         while ((entry = readdir (handle)) != NULL)
-            list = g_list_prepend (list, g_strdup (entry->d_name));
+            g_hash_table_insert (names, g_ascii_strdown (entry->d_name, -1),
+             g_strdup (entry->d_name));
 
-        g_hash_table_insert (cache, g_strdup (folder), list);
+        g_hash_table_insert (dir_cache, g_strdup (folder), names);
         closedir (handle);
     }
 
-    for (; list != NULL; list = list->next)
-    {
-        if (! strcasecmp (list->data, basename))
-            return g_strdup (list->data);
-    }
+    gchar * key = g_ascii_strdown (basename, -1);
+    const gchar * found = g_hash_table_lookup (names, key);
+    g_free (key);
 
-    return NULL;
+    return g_strdup (found);
 }
 
 gchar * find_file_case_path (const gchar * folder, const gchar * basename)
@@ -408,6 +410,9 @@ void del_directory(const gchar *path)
 {
     dir_foreach(path, del_directory_func, NULL, NULL);
     rmdir(path);
+
+    if (dir_cache)
+        g_hash_table_remove (dir_cache, path);
 }
 
 static void strip_string(GString *string)
@@ -0,0 +1,274 @@
+/*
+ * update_timer.h
+ * Copyright 2012 Audacious Plugins Team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* Refresh timer for displays of the playback time.  Instead of polling at a
+ * fixed rate, the update function runs once just after each whole second of
+ * playback time (elapsed or remaining), when the displayed value actually
+ * changes.  Playback hooks (seek, pause, ...) trigger a single coalesced
+ * update from the main loop.  While stopped, paused or hidden, no such timer
+ * runs at all.
+ *
+ * Things without a change hook (the volume) can be polled with a separate
+ * function: four times a second during playback, rarely while stopped or
+ * paused, and not at all while hidden. */
+
+#ifndef AUD_UI_COMMON_UPDATE_TIMER_H
+#define AUD_UI_COMMON_UPDATE_TIMER_H
+
+#include <glib.h>
+
+#include <audacious/debug.h>
+#include <audacious/drct.h>
+#include <libaudcore/hook.h>
+
+#define UPDATE_TIMER_SLACK 10     /* ms past the second, so the value has changed */
+#define UPDATE_TIMER_REPORT 60    /* seconds between wakeup rate reports */
+#define UPDATE_TIMER_POLL 250     /* ms between polls during playback */
+#define UPDATE_TIMER_POLL_IDLE 2000 /* ms between polls while stopped or paused */
+#define UPDATE_TIMER_MIN_STEP 100 /* ms, shortest step accepted */
+
+typedef struct {
+    const gchar * name;
+    void (* func) (void);
+    guint source;
+    gboolean pending;    /* source is a coalesced update from a hook */
+    gboolean hidden;
+    gint deadline;       /* extra playback time to wake up at, or -1 */
+    gboolean remaining;  /* align to seconds of remaining time instead */
+    gint step;           /* extra wakeup every step ms of playback, or 0 */
+    void (* poll) (void);
+    guint poll_source;
+    gint poll_interval;  /* of poll_source, 0 if none */
+    guint wakeups;       /* of both the timer and the poll */
+    gint64 report_time;
+} UpdateTimer;
+
+static void update_timer_schedule (UpdateTimer * t);
+
+static void update_timer_count (UpdateTimer * t)
+{
+    gint64 now = g_get_monotonic_time ();
+    t->wakeups ++;
+
+    if (now - t->report_time >= (gint64) UPDATE_TIMER_REPORT * G_USEC_PER_SEC)
+    {
+        AUDDBG ("%s: %.2f wakeups per second.\n", t->name, t->wakeups *
+         (gdouble) G_USEC_PER_SEC / (now - t->report_time));
+        t->wakeups = 0;
+        t->report_time = now;
+    }
+}
+
+static gboolean update_timer_fire (void * data)
+{
+    UpdateTimer * t = data;
+
+    t->source = 0;
+    t->pending = FALSE;
+
+    update_timer_count (t);
+
+    t->func ();
+    update_timer_schedule (t);
+    return FALSE;
+}
+
+static gboolean update_timer_poll_fire (void * data)
+{
+    UpdateTimer * t = data;
+
+    update_timer_count (t);
+
+    t->poll ();
+    return TRUE;
+}
+
+static void update_timer_poll_schedule (UpdateTimer * t)
+{
+    gint interval = 0;
+
+    if (t->poll && ! t->hidden)
+        interval = (aud_drct_get_playing () && ! aud_drct_get_paused ()) ?
+         UPDATE_TIMER_POLL : UPDATE_TIMER_POLL_IDLE;
+
+    if (interval == t->poll_interval)
+        return;
+
+    if (t->poll_source)
+        g_source_remove (t->poll_source);
+
+    t->poll_source = interval ? g_timeout_add (interval, update_timer_poll_fire, t) : 0;
+    t->poll_interval = interval;
+}
+
+static void update_timer_schedule (UpdateTimer * t)
+{
+    if (t->source)
+    {
+        g_source_remove (t->source);
+        t->source = 0;
+        t->pending = FALSE;
+    }
+
+    update_timer_poll_schedule (t);
+
+    if (! aud_drct_get_playing () || aud_drct_get_paused () || ! aud_drct_get_ready ())
+        return;
+
+    gint time = aud_drct_get_time ();
+    gint length = t->remaining ? aud_drct_get_length () : -1;
+    gint delay;
+
+    if (length > time)
+        delay = (length - time) % 1000 + 1;
+    else
+        delay = 1000 - (time > 0 ? time % 1000 : 0);
+
+    if (t->step > 0 && t->step - (time > 0 ? time % t->step : 0) < delay)
+        delay = t->step - (time > 0 ? time % t->step : 0);
+
+    /* a deadline is kept even while hidden */
+    if (t->hidden)
+    {
+        if (t->deadline <= time)
+            return;
+        delay = t->deadline - time;
+    }
+    else if (t->deadline > time && t->deadline - time < delay)
+        delay = t->deadline - time;
+
+    t->source = g_timeout_add (delay + UPDATE_TIMER_SLACK, update_timer_fire, t);
+}
+
+/* Runs the update function once from the main loop; several calls before it
+ * runs are merged into one.  The timer is rescheduled afterwards. */
+static inline void update_timer_update (UpdateTimer * t)
+{
+    if (t->pending)
+        return;
+
+    if (t->source)
+        g_source_remove (t->source);
+
+    t->source = g_idle_add (update_timer_fire, t);
+    t->pending = TRUE;
+}
+
+/* Stops the timer and the poll while the display is not visible and catches
+ * up when it is shown again. */
+static inline void update_timer_set_hidden (UpdateTimer * t, gboolean hidden)
+{
+    if (t->hidden == hidden)
+        return;
+
+    t->hidden = hidden;
+
+    if (hidden)
+        update_timer_schedule (t);
+    else
+    {
+        if (t->poll)
+            t->poll ();
+        update_timer_update (t);
+    }
+}
+
+/* Sets what the display shows: remaining instead of elapsed seconds, and an
+ * optional finer step in ms (e.g. one pixel of a position slider).  Takes
+ * effect when the timer is next scheduled, which is right after the update
+ * function returns if called from there. */
+static inline void update_timer_set_alignment (UpdateTimer * t,
+ gboolean remaining, gint step)
+{
+    t->remaining = remaining;
+    t->step = (step > 0 && step < UPDATE_TIMER_MIN_STEP) ? UPDATE_TIMER_MIN_STEP : step;
+}
+
+/* Calls func periodically, more rarely while stopped or paused and never
+ * while hidden.  The first call comes after one interval, so the caller
+ * should bring the display up to date itself. */
+static inline void update_timer_set_poll (UpdateTimer * t, void (* func) (void))
+{
+    t->poll = func;
+    update_timer_poll_schedule (t);
+}
+
+/* Requests an extra wakeup at the given playback time (-1 for none), for
+ * things that must happen on time rather than once a second, visible or not. */
+static inline void update_timer_set_deadline (UpdateTimer * t, gint time)
+{
+    t->deadline = time;
+
+    if (! t->pending)
+        update_timer_schedule (t);
+}
+
+static void update_timer_hook (void * data, void * t)
+{
+    update_timer_update (t);
+}
+
+static inline void update_timer_start (UpdateTimer * t, const gchar * name,
+ void (* func) (void))
+{
+    t->name = name;
+    t->func = func;
+    t->source = 0;
+    t->pending = FALSE;
+    t->hidden = FALSE;
+    t->deadline = -1;
+    t->remaining = FALSE;
+    t->step = 0;
+    t->poll = NULL;
+    t->poll_source = 0;
+    t->poll_interval = 0;
+    t->wakeups = 0;
+    t->report_time = g_get_monotonic_time ();
+
+    hook_associate ("playback begin", update_timer_hook, t);
+    hook_associate ("playback ready", update_timer_hook, t);
+    hook_associate ("playback pause", update_timer_hook, t);
+    hook_associate ("playback unpause", update_timer_hook, t);
+    hook_associate ("playback seek", update_timer_hook, t);
+    hook_associate ("playback stop", update_timer_hook, t);
+
+    update_timer_update (t);
+}
+
+static inline void update_timer_stop (UpdateTimer * t)
+{
+    hook_dissociate ("playback begin", update_timer_hook);
+    hook_dissociate ("playback ready", update_timer_hook);
+    hook_dissociate ("playback pause", update_timer_hook);
+    hook_dissociate ("playback unpause", update_timer_hook);
+    hook_dissociate ("playback seek", update_timer_hook);
+    hook_dissociate ("playback stop", update_timer_hook);
+
+    if (t->source)
+        g_source_remove (t->source);
+    if (t->poll_source)
+        g_source_remove (t->poll_source);
+
+    t->source = 0;
+    t->pending = FALSE;
+    t->poll_source = 0;
+    t->poll_interval = 0;
+}
+
+#endif
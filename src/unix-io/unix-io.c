@@ -34,14 +34,25 @@
 
 #include "config.h"
 
-#define INT_TO_POINTER(x) ((void *) (ptrdiff_t) (x))
-#define POINTER_TO_INT(x) ((int) (ptrdiff_t) (x))
-
 #define unix_error(...) do { \
     SPRINTF (unix_error_buf, __VA_ARGS__); \
     aud_interface_show_error (unix_error_buf); \
 } while (0)
 
+/* Reads are served from a per-handle buffer of this size.  Reads as large as
+ * the buffer bypass it.  Writes always go straight to the file. */
+#define UNIX_BUF_SIZE 65536
+
+typedef struct {
+    int fd;
+    bool_t append;
+    int64_t pos;         /* position seen by the caller */
+    int64_t fd_pos;      /* position of the file descriptor, -1 if unknown */
+    unsigned char * buf; /* allocated on first read */
+    int64_t buf_start;   /* file position of buf[0] */
+    int64_t buf_len;     /* valid bytes in buf */
+} UnixFile;
+
 static void * unix_fopen (const char * uri, const char * mode)
 {
     bool_t update;
@@ -93,43 +104,132 @@ static void * unix_fopen (const char * uri, const char * mode)
     }
 
     free (filename);
-    return INT_TO_POINTER (handle);
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    if (mode[0] == 'r')
+    {
+        /* most files are read from start to end; get the first block early */
+        posix_fadvise (handle, 0, 0, POSIX_FADV_SEQUENTIAL);
+        posix_fadvise (handle, 0, UNIX_BUF_SIZE, POSIX_FADV_WILLNEED);
+    }
+#endif
+
+    UnixFile * unix_file = malloc (sizeof (UnixFile));
+
+    unix_file->fd = handle;
+    unix_file->append = (mode[0] == 'a');
+    unix_file->pos = 0;
+    unix_file->fd_pos = 0;
+    unix_file->buf = NULL;
+    unix_file->buf_start = 0;
+    unix_file->buf_len = 0;
+
+    return unix_file;
 }
 
 static int unix_fclose (VFSFile * file)
 {
-    int handle = POINTER_TO_INT (vfs_get_handle (file));
+    UnixFile * unix_file = vfs_get_handle (file);
     int result = 0;
 
-    if (close (handle) < 0)
+    if (close (unix_file->fd) < 0)
     {
         unix_error ("close failed: %s.", strerror (errno));
         result = -1;
     }
 
+    free (unix_file->buf);
+    free (unix_file);
+
     return result;
 }
 
+/* moves the file descriptor to the caller's position, if needed */
+static bool_t unix_sync_pos (UnixFile * unix_file)
+{
+    if (unix_file->fd_pos == unix_file->pos)
+        return TRUE;
+
+    if (lseek (unix_file->fd, unix_file->pos, SEEK_SET) < 0)
+    {
+        unix_error ("lseek failed: %s.", strerror (errno));
+        unix_file->fd_pos = -1;
+        return FALSE;
+    }
+
+    unix_file->fd_pos = unix_file->pos;
+    return TRUE;
+}
+
+/* reads up to size bytes at the current position, straight from the file */
+static int64_t unix_read_direct (UnixFile * unix_file, void * ptr, int64_t size)
+{
+    if (! unix_sync_pos (unix_file))
+        return -1;
+
+    int64_t readed = read (unix_file->fd, ptr, size);
+
+    if (readed < 0)
+    {
+        unix_error ("read failed: %s.", strerror (errno));
+        unix_file->fd_pos = -1;
+        return -1;
+    }
+
+    unix_file->fd_pos += readed;
+    return readed;
+}
+
 static int64_t unix_fread (void * ptr, int64_t size, int64_t nitems, VFSFile * file)
 {
-    int handle = POINTER_TO_INT (vfs_get_handle (file));
+    UnixFile * unix_file = vfs_get_handle (file);
     int64_t goal = size * nitems;
     int64_t total = 0;
 
     while (total < goal)
     {
-        int64_t readed = read (handle, (char *) ptr + total, goal - total);
+        int64_t offset = unix_file->pos - unix_file->buf_start;
+        int64_t readed;
 
-        if (readed < 0)
+        /* serve what we can from the buffer */
+        if (offset >= 0 && offset < unix_file->buf_len)
         {
-            unix_error ("read failed: %s.", strerror (errno));
-            break;
+            readed = unix_file->buf_len - offset;
+            if (readed > goal - total)
+                readed = goal - total;
+
+            memcpy ((char *) ptr + total, unix_file->buf + offset, readed);
+            unix_file->pos += readed;
+            total += readed;
+            continue;
         }
 
-        if (! readed)
+        /* large reads bypass the buffer */
+        if (goal - total >= UNIX_BUF_SIZE)
+        {
+            readed = unix_read_direct (unix_file, (char *) ptr + total, goal - total);
+
+            if (readed <= 0)
+                break;
+
+            unix_file->pos += readed;
+            total += readed;
+            continue;
+        }
+
+        /* refill the buffer */
+        if (! unix_file->buf)
+            unix_file->buf = malloc (UNIX_BUF_SIZE);
+
+        unix_file->buf_start = unix_file->pos;
+        unix_file->buf_len = 0;
+
+        readed = unix_read_direct (unix_file, unix_file->buf, UNIX_BUF_SIZE);
+
+        if (readed <= 0)
             break;
 
-        total += readed;
+        unix_file->buf_len = readed;
     }
 
     return (size > 0) ? total / size : 0;
@@ -138,13 +238,19 @@ static int64_t unix_fread (void * ptr, int64_t size, int64_t nitems, VFSFile * f
 static int64_t unix_fwrite (const void * ptr, int64_t size, int64_t nitems,
  VFSFile * file)
 {
-    int handle = POINTER_TO_INT (vfs_get_handle (file));
+    UnixFile * unix_file = vfs_get_handle (file);
     int64_t goal = size * nitems;
     int64_t total = 0;
 
+    /* the buffer might hold data we are about to overwrite */
+    unix_file->buf_len = 0;
+
+    if (! unix_file->append && ! unix_sync_pos (unix_file))
+        return 0;
+
     while (total < goal)
     {
-        int64_t written = write (handle, (char *) ptr + total, goal - total);
+        int64_t written = write (unix_file->fd, (char *) ptr + total, goal - total);
 
         if (written < 0)
         {
@@ -155,37 +261,72 @@ static int64_t unix_fwrite (const void * ptr, int64_t size, int64_t nitems,
         total += written;
     }
 
+    if (unix_file->append)
+        unix_file->fd_pos = lseek (unix_file->fd, 0, SEEK_CUR);
+    else
+        unix_file->fd_pos += total;
+
+    unix_file->pos = unix_file->fd_pos;
+
     return (size > 0) ? total / size : 0;
 }
 
 static int unix_fseek (VFSFile * file, int64_t offset, int whence)
 {
-    int handle = POINTER_TO_INT (vfs_get_handle (file));
+    UnixFile * unix_file = vfs_get_handle (file);
+    int64_t pos;
 
-    if (lseek (handle, offset, whence) < 0)
+    switch (whence)
     {
-        unix_error ("lseek failed: %s.", strerror (errno));
+      case SEEK_SET:
+        pos = offset;
+        break;
+      case SEEK_CUR:
+        pos = unix_file->pos + offset;
+        break;
+      default:
+        /* the file size is needed; let the kernel do it */
+        if ((pos = lseek (unix_file->fd, offset, whence)) < 0)
+        {
+            unix_error ("lseek failed: %s.", strerror (errno));
+            unix_file->fd_pos = -1;
+            return -1;
+        }
+
+        unix_file->fd_pos = pos;
+        break;
+    }
+
+    if (pos < 0)
+    {
+        unix_error ("lseek failed: %s.", strerror (EINVAL));
         return -1;
     }
 
+    /* the file descriptor is moved lazily, on the next read or write */
+    unix_file->pos = pos;
     return 0;
 }
 
 static int64_t unix_ftell (VFSFile * file)
 {
-    int handle = POINTER_TO_INT (vfs_get_handle (file));
-    int64_t result = lseek (handle, 0, SEEK_CUR);
+    UnixFile * unix_file = vfs_get_handle (file);
 
-    if (result < 0)
-        unix_error ("lseek failed: %s.", strerror (errno));
-
-    return result;
+    return unix_file->pos;
 }
 
 static int unix_getc (VFSFile * file)
 {
+    UnixFile * unix_file = vfs_get_handle (file);
+    int64_t offset = unix_file->pos - unix_file->buf_start;
     unsigned char c;
 
+    if (offset >= 0 && offset < unix_file->buf_len)
+    {
+        unix_file->pos ++;
+        return unix_file->buf[offset];
+    }
+
     return (unix_fread (& c, 1, 1, file) == 1) ? c : -1;
 }
 
@@ -212,9 +353,11 @@ static bool_t unix_feof (VFSFile * file)
 
 static int unix_ftruncate (VFSFile * file, int64_t length)
 {
-    int handle = POINTER_TO_INT (vfs_get_handle (file));
+    UnixFile * unix_file = vfs_get_handle (file);
+
+    unix_file->buf_len = 0;
 
-    int result = ftruncate (handle, length);
+    int result = ftruncate (unix_file->fd, length);
 
     if (result < 0)
         unix_error ("ftruncate failed: %s.", strerror (errno));
@@ -224,19 +367,29 @@ static int unix_ftruncate (VFSFile * file, int64_t length)
 
 static int64_t unix_fsize (VFSFile * file)
 {
-    int64_t position, length;
+    UnixFile * unix_file = vfs_get_handle (file);
+    struct stat st;
+
+    if (fstat (unix_file->fd, & st) < 0)
+    {
+        unix_error ("fstat failed: %s.", strerror (errno));
+        return -1;
+    }
 
-    position = unix_ftell (file);
+    if (S_ISREG (st.st_mode))
+        return st.st_size;
 
-    if (position < 0)
+    /* pipes, sockets and character devices have no size; st_size is 0 for
+     * block devices, but they can seek to their end */
+    if (! S_ISBLK (st.st_mode))
         return -1;
 
-    unix_fseek (file, 0, SEEK_END);
-    length = unix_ftell (file);
+    int64_t position = unix_ftell (file);
 
-    if (length < 0)
+    if (position < 0 || unix_fseek (file, 0, SEEK_END) < 0)
         return -1;
 
+    int64_t length = unix_ftell (file);
     unix_fseek (file, position, SEEK_SET);
 
     return length;
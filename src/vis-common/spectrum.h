@@ -0,0 +1,135 @@
+/*
+ * spectrum.h
+ * Copyright 2012 Audacious Plugins Team
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/* Logarithmic band mapping shared by the spectrum visualizers.  The 256 linear
+ * frequency bins are summed into bands whose edges lie at 257^(i/bands) - 1,
+ * counting the bins cut by an edge in proportion.  Since the edges only depend
+ * on the number of bands, the weights are computed once and each frame is a
+ * short run of multiply-adds per band. */
+
+#ifndef AUD_VIS_COMMON_SPECTRUM_H
+#define AUD_VIS_COMMON_SPECTRUM_H
+
+#include <math.h>
+#include <string.h>
+#include <glib.h>
+
+#define SPECTRUM_BINS 256
+
+typedef struct {
+    gint bands;
+    gfloat scale;
+    gint * start;      /* first bin of each band */
+    gint * len;        /* number of bins in each band */
+    gfloat * weights;  /* len[i] weights per band, back to back */
+} SpectrumMap;
+
+static inline void spectrum_map_free (SpectrumMap * map)
+{
+    g_free (map->start);
+    g_free (map->len);
+    g_free (map->weights);
+    memset (map, 0, sizeof (SpectrumMap));
+}
+
+/* (Re)builds the map for the given number of bands unless it is current.  All
+ * weights are multiplied by <scale>. */
+static inline void spectrum_map_set (SpectrumMap * map, gint bands, gfloat scale)
+{
+    if (map->bands == bands && map->scale == scale)
+        return;
+
+    spectrum_map_free (map);
+
+    map->bands = bands;
+    map->scale = scale;
+    map->start = g_new (gint, bands);
+    map->len = g_new (gint, bands);
+    map->weights = g_new (gfloat, SPECTRUM_BINS + 2 * bands);
+
+    gfloat * w = map->weights;
+    gfloat x0 = 0;
+
+    for (gint i = 0; i < bands; i ++)
+    {
+        gfloat x1 = powf (SPECTRUM_BINS + 1, (gfloat) (i + 1) / bands) - 1;
+        gint a = ceilf (x0);
+        gint b = floorf (x1);
+        gfloat * first = w;
+
+        if (b < a)
+        {
+            map->start[i] = b;
+            * w ++ = (x1 - x0) * scale;
+        }
+        else
+        {
+            map->start[i] = (a > 0) ? a - 1 : a;
+
+            if (a > 0)
+                * w ++ = (a - x0) * scale;
+            for (; a < b; a ++)
+                * w ++ = scale;
+            if (b < SPECTRUM_BINS)
+                * w ++ = (x1 - b) * scale;
+        }
+
+        map->len[i] = w - first;
+        x0 = x1;
+    }
+}
+
+/* Writes the summed (linear, not dB) level of each band to <out>. */
+static inline void spectrum_map_apply (const SpectrumMap * map,
+ const gfloat * freq, gfloat * out)
+{
+    const gfloat * w = map->weights;
+
+    for (gint i = 0; i < map->bands; i ++)
+    {
+        const gfloat * f = freq + map->start[i];
+        gint len = map->len[i];
+        gfloat sum = 0;
+
+        for (gint j = 0; j < len; j ++)
+            sum += w[j] * f[j];
+
+        out[i] = sum;
+        w += len;
+    }
+}
+
+/* Peak hold for bar displays: a bar jumps up to <level> at once and then sinks
+ * by up to <falloff> per frame, starting slowly over the first <hold> frames. */
+static inline void spectrum_peak (gint level, gint * bar, gint * delay,
+ gint hold, gint falloff)
+{
+    * bar -= MAX (0, falloff - * delay);
+
+    if (* delay)
+        (* delay) --;
+
+    if (level > * bar)
+    {
+        * bar = level;
+        * delay = hold;
+    }
+}
+
+#endif